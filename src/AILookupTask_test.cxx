@@ -5,8 +5,8 @@
 #include "evio/EventLoop.h"
 #include "utils/AIAlert.h"
 #include "utils/debug_ostream_operators.h"
+#include "EngineDriver.h"
 #include "debug.h"
-#include <thread>
 #include <atomic>
 
 int constexpr queue_capacity = 32;
@@ -52,18 +52,15 @@ int main()
     resolver::Scope resolver_scope(handler, false);
 
     AIEngine engine("main engine", 2.0);
+    statefultask::EngineDriver engine_driver(engine, std::chrono::milliseconds(2));
     getaddrinfo_task = new task::GetAddrInfo(CWDEBUG_ONLY(true));
 
     getaddrinfo_task->init("www.google.com", "www");
-    getaddrinfo_task->run(&engine, &callback);
+    getaddrinfo_task->run(&engine, [&](bool success){ callback(success); engine_driver.wake_up(); });
 
     // Mainloop.
     Dout(dc::notice, "Starting main loop...");
-    while (test_finished < 2)
-    {
-      engine.mainloop();
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
+    engine_driver.run_until([](){ return test_finished >= 2; });
 
     // Terminate application.
     event_loop.join();
@@ -8,6 +8,9 @@
 #include "utils/debug_ostream_operators.h"
 #include "debug.h"
 #include "cwds/benchmark.h"
+#include "CpuFrequency.h"
+#include "TaskArena.h"
+#include "RunAll.h"
 #include <chrono>
 
 namespace utils { using namespace threading; }
@@ -15,7 +18,7 @@ namespace utils { using namespace threading; }
 constexpr int queue_capacity = 100032; //32;
 constexpr int number_of_tasks = 100000;
 
-class MyTask : public AIStatefulTask
+class MyTask : public AIStatefulTask, public statefultask::TaskArenaAllocated
 {
  protected:
   /// The base class of this task.
@@ -73,7 +76,6 @@ AIStatefulTaskMutex mutex;
 
 std::atomic<int> m_inside_critical_area = ATOMIC_VAR_INIT(0);
 std::atomic<int> m_locked = ATOMIC_VAR_INIT(0);
-std::atomic<int> finished_counter = ATOMIC_VAR_INIT(0);
 bool first = true;
 
 void MyTask::multiplex_impl(state_type state)
@@ -125,6 +127,8 @@ int main()
 
   AIMemoryPagePool mpp;
 
+  benchmark::CpuFrequency::cycles_per_second();
+
   benchmark::Stopwatch sw;
   sw.start();
 
@@ -137,7 +141,7 @@ int main()
     AIStatefulTaskMutex::s_node_memory_resource.deallocate(ptr);
 
   sw.stop();
-  std::cout << "Ran for " << (sw.diff_cycles() / 3612059050.0) << " seconds." << std::endl;
+  std::cout << "Ran for " << benchmark::CpuFrequency::seconds(sw.diff_cycles()) << " seconds." << std::endl;
 
   AIThreadPool thread_pool;
   Debug(thread_pool.set_color_functions([](int color){ std::string code{"\e[30m"}; code[3] = '1' + color; return code; }));
@@ -156,20 +160,14 @@ int main()
 
     sw.start();
 
-    for (int i = 0; i < number_of_tasks; ++i)
-    {
-      tasks[i]->run(handler, [&test_finished COMMA_CWDEBUG_ONLY(i)](bool success){
-            if (!success)
-              Dout(dc::warning, "MyTask was aborted.");
-            else
-            {
-              Dout(dc::notice, "MyTask " << i << " finished.");
-              if (finished_counter++ == number_of_tasks - 1)
-                test_finished.open();
-            }
-          });
-    }
-    Dout(dc::notice, "Done adding " << number_of_tasks << " to the thread pool queue.");
+    statefultask::run_all(tasks, handler, [&test_finished](bool success){
+          if (!success)
+            Dout(dc::warning, "One or more MyTask's were aborted.");
+          else
+            Dout(dc::notice, "All MyTask's finished.");
+          test_finished.open();
+        });
+    Dout(dc::notice, "Done adding " << number_of_tasks << " tasks to the thread pool queue.");
 
     // Wait until the test is finished.
     test_finished.wait();
@@ -179,7 +177,7 @@ int main()
     ASSERT(m_inside_critical_area == 0);
     ASSERT(m_locked == 0);
 
-    std::cout << "Ran for " << (sw.diff_cycles() / 3612059050.0) << " seconds." << std::endl;
+    std::cout << "Ran for " << benchmark::CpuFrequency::seconds(sw.diff_cycles()) << " seconds." << std::endl;
 
     // Terminate application.
 //    event_loop.join();
@@ -189,5 +187,8 @@ int main()
     Dout(dc::warning, error);
   }
 
+  // Before mpp is destroyed.
+  statefultask::TaskArena::flush_remote_frees();
+
   Dout(dc::notice, "Leaving main()...");
 }
@@ -4,10 +4,11 @@
 #include "statefultask/AIEngine.h"
 #include "statefultask/DefaultMemoryPagePool.h"
 #include "threadpool/AIThreadPool.h"
-#include <thread>
+#include "EngineDriver.h"
+#include <atomic>
 
 int constexpr queue_capacity = 32;
-bool test_finished = false;
+std::atomic_bool test_finished = false;
 
 template<threadpool::Timer::time_point::rep count, typename Unit> using Interval = threadpool::Interval<count, Unit>;
 
@@ -38,20 +39,17 @@ int main()
   [[maybe_unused]] AIQueueHandle handler = thread_pool.new_queue(queue_capacity);
 
   AIEngine engine("main engine", 2.0);
+  statefultask::EngineDriver engine_driver(engine, std::chrono::milliseconds(2));
   boost::intrusive_ptr<AITimer> timer = statefultask::create<AITimer>(CWDEBUG_ONLY(true));
 
   timer->set_interval(Interval<2, std::chrono::milliseconds>());
 
   start_time = std::chrono::system_clock::now();
-  timer->run(&callback);
+  timer->run([&](bool success){ callback(success); engine_driver.wake_up(); });
 
   // Mainloop.
   Dout(dc::notice, "Starting main loop...");
-  while (!test_finished)
-  {
-    engine.mainloop();
-    std::this_thread::sleep_for(std::chrono::milliseconds(10));
-  }
+  engine_driver.run_until([](){ return test_finished.load(); });
 
   Dout(dc::notice, "Leaving main()...");
 }
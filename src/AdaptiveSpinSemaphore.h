@@ -0,0 +1,123 @@
+#pragma once
+
+#include "utils/threading/SpinSemaphore.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace threadpool {
+
+// How long an idle thread spins before it goes to sleep on the futex.
+//
+// A thread that waits on a utils::SpinSemaphore either gets a token right away or calls
+// slow_wait(), which costs a futex round trip of several microseconds (see cv_wait.cxx)
+// when the token arrives. If tokens arrive every few microseconds, that wake up latency
+// dominates the run time of short tasks; spinning a little longer avoids it, but spinning
+// when the next token is milliseconds away just burns a core.
+//
+// The policy learns the average time between two post()s (an exponentially weighted
+// moving average) and spins for spin_factor times that average, but only when the
+// average is below max_spin; otherwise it goes to sleep immediately.
+struct IdlePolicy
+{
+  std::chrono::nanoseconds min_spin{0};                 // Always spin at least this long.
+  std::chrono::nanoseconds max_spin{20000};             // Never spin longer than this (about a few futex round trips).
+  double spin_factor = 2.0;                             // Spin for this many times the average inter-arrival time.
+  int ewma_shift = 3;                                   // The weight of a new sample is 1 / 2^ewma_shift.
+};
+
+// A utils::SpinSemaphore that spins for a learned duration before it sleeps.
+//
+// Every semaphore (for example, one per queue) has its own IdlePolicy and its own
+// inter-arrival statistics.
+//
+// Usage:
+//
+//   threadpool::AdaptiveSpinSemaphore semaphore({ .max_spin = std::chrono::microseconds(10) });
+//   semaphore.post();                                  // Producer.
+//   semaphore.wait();                                  // Consumer.
+class AdaptiveSpinSemaphore : public utils::threading::SpinSemaphore
+{
+ private:
+  using clock_type = std::chrono::steady_clock;
+
+  IdlePolicy const m_policy;
+  std::atomic<int64_t> m_average_ns;                    // The average time between two calls to post().
+  std::atomic<int64_t> m_last_post_ns = ATOMIC_VAR_INIT(0);
+  std::atomic<uint64_t> m_fast = ATOMIC_VAR_INIT(0);    // Tokens that were obtained without sleeping.
+  std::atomic<uint64_t> m_slow = ATOMIC_VAR_INIT(0);    // Tokens that were obtained after sleeping.
+
+  static int64_t now_ns()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now().time_since_epoch()).count();
+  }
+
+  static void cpu_relax()
+  {
+    asm volatile ("pause" ::: "memory");
+  }
+
+ public:
+  AdaptiveSpinSemaphore(IdlePolicy const& policy = {}) :
+    m_policy(policy), m_average_ns(policy.max_spin.count()) { }
+
+  IdlePolicy const& policy() const { return m_policy; }
+
+  // The current average inter-arrival time and the resulting spin time.
+  std::chrono::nanoseconds average_inter_arrival() const { return std::chrono::nanoseconds(m_average_ns.load(std::memory_order_relaxed)); }
+  std::chrono::nanoseconds spin_duration() const
+  {
+    int64_t const average = m_average_ns.load(std::memory_order_relaxed);
+    if (average > m_policy.max_spin.count())
+      return m_policy.min_spin;
+    return std::clamp(std::chrono::nanoseconds(static_cast<int64_t>(m_policy.spin_factor * average)), m_policy.min_spin, m_policy.max_spin);
+  }
+
+  uint64_t fast_count() const { return m_fast.load(std::memory_order_relaxed); }
+  uint64_t slow_count() const { return m_slow.load(std::memory_order_relaxed); }
+
+  void post(uint32_t n = 1)
+  {
+    int64_t const now = now_ns();
+    int64_t const last = m_last_post_ns.exchange(now, std::memory_order_relaxed);
+    if (last != 0)
+    {
+      // Concurrent posts may lose an update of the average; it is only a heuristic.
+      int64_t const average = m_average_ns.load(std::memory_order_relaxed);
+      m_average_ns.store(average + ((now - last - average) >> m_policy.ewma_shift), std::memory_order_relaxed);
+    }
+    SpinSemaphore::post(n);
+  }
+
+  void wait()
+  {
+    uint64_t word = fast_try_wait();
+    if ((word & tokens_mask) == 0)
+    {
+      int64_t const spin_ns = spin_duration().count();
+      if (spin_ns > 0)
+      {
+        int64_t const deadline = now_ns() + spin_ns;
+        do
+        {
+          for (int i = 0; i < 16; ++i)
+            cpu_relax();
+          word = fast_try_wait();
+          if ((word & tokens_mask) != 0)
+          {
+            m_fast.fetch_add(1, std::memory_order_relaxed);
+            return;
+          }
+        }
+        while (now_ns() < deadline);
+      }
+      slow_wait(word);
+      m_slow.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+      m_fast.fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+} // namespace threadpool
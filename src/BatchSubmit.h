@@ -0,0 +1,55 @@
+#pragma once
+
+#include "threadpool/AIThreadPool.h"
+#include <algorithm>
+#include <iterator>
+#include <thread>
+
+namespace threadpool {
+
+// Add several functors to an AIThreadPool queue at once.
+//
+// Adding N functors one by one costs N producer_access() lock round trips and N calls
+// to notify_one(). submit_batch takes the producer lock once, moves in as many functors
+// as fit, and then calls notify_one() only min(N, max_wakeups) times: waking up more
+// threads than the pool has is pointless, since each woken thread keeps running
+// functors from the queue until it is empty.
+//
+// Usage:
+//
+//   auto queues_access = thread_pool.queues_read_access();
+//   auto& queue = thread_pool.get_queue(queues_access, queue_handle);
+//   int added = threadpool::submit_batch(queue, capacity, 100, [&](int i){ return [i](){ ...; return false; }; });
+//
+// The generator is called with 0, 1, ..., n - 1 and must return the functor to add.
+// The return value is the number of functors that were added (less than n if the
+// queue became full).
+template<typename QUEUE, typename GENERATOR>
+int submit_batch(QUEUE& queue, int capacity, int n, GENERATOR&& generator, int max_wakeups = std::thread::hardware_concurrency())
+{
+  int added;
+  {
+    auto queue_access = queue.producer_access();
+    added = std::min(n, capacity - static_cast<int>(queue_access.length()));
+    for (int i = 0; i < added; ++i)
+      queue_access.move_in(generator(i));
+  }
+  int const wakeups = std::min(added, max_wakeups);
+  for (int i = 0; i < wakeups; ++i)
+    queue.notify_one();
+  return std::max(added, 0);
+}
+
+// The same, but moves the functors of the range [first, last) into the queue.
+// Returns an iterator to the first functor that was not moved (last if all fit).
+template<typename QUEUE, typename ITERATOR>
+ITERATOR move_in_range(QUEUE& queue, int capacity, ITERATOR first, ITERATOR last, int max_wakeups = std::thread::hardware_concurrency())
+{
+  int const n = std::distance(first, last);
+  // submit_batch calls the generator with 0, 1, ..., added - 1: advance a single iterator, rather than std::next(first, i) per functor.
+  ITERATOR next = first;
+  submit_batch(queue, capacity, n, [&next](int){ return std::move(*next++); }, max_wakeups);
+  return next;
+}
+
+} // namespace threadpool
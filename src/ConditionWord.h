@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "debug.h"
+
+namespace statefultask {
+
+// The wait/signal state of a task packed into a single atomic word.
+//
+// Every condition has a counter with three values (see wait_signal_test2.cxx, which
+// models this for two normal and two required conditions):
+//
+//   0 : the task is idle, waiting for this condition.
+//   1 : the task is running (the initial value).
+//   2 : the condition was signalled while the task was running; the next wait() for it
+//       doesn't go idle.
+//
+// wait(conditions) decrements the counters of conditions, signal(conditions) increments
+// them (saturating at 2). A task that is waiting is woken up when one of the normal
+// conditions it waits for is signalled (they are OR-ed), but only when none of the
+// required conditions it waits for is still at 0 (they are AND-ed). Waking up resets all
+// counters to 1.
+//
+// The counters are stored with two bits per condition in one 32-bit word, and every
+// operation is a single compare-and-swap of the whole word, so signal() never takes a
+// lock and exactly one caller observes the transition from idle to running. The
+// transitions themselves are pure functions of the word, which is what
+// wait_signal_test2 checks against the reference model.
+class ConditionWord
+{
+ public:
+  using word_type = uint32_t;
+  using condition_type = uint32_t;                      // Bit i is condition i.
+
+  static constexpr int max_conditions = 16;
+  static constexpr word_type low_bits = 0x55555555;     // The low bit of every counter.
+  static constexpr word_type running_word = low_bits;   // All counters 1.
+
+  struct Transition
+  {
+    word_type m_word;                                   // The new word.
+    bool m_result;                                      // See signal() and wait().
+  };
+
+  // Spread the bits of conditions to the low bit of the corresponding counters.
+  static constexpr word_type counter_bits(condition_type conditions)
+  {
+    word_type x = conditions & 0xffff;
+    x = (x | (x << 8)) & 0x00ff00ff;
+    x = (x | (x << 4)) & 0x0f0f0f0f;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    return x;
+  }
+
+  // The low bit of every counter that is 0.
+  static constexpr word_type idle_bits(word_type word) { return ~(word | (word >> 1)) & low_bits; }
+
+  static constexpr int counter(word_type word, int condition) { return (word >> (2 * condition)) & 3; }
+
+  static constexpr Transition signal_transition(word_type word, condition_type conditions, condition_type required)
+  {
+    word_type const required_bits = counter_bits(required);
+    word_type const idle = idle_bits(word);
+    bool const was_idle = idle != 0;
+    word_type const signalled = counter_bits(conditions);
+    // Counters at 2 saturate. While idle, a counter that isn't waiting (not 0) ignores the signal.
+    word_type const saturated = (word >> 1) & low_bits;
+    word_type const increment = signalled & ~saturated & (was_idle ? idle : low_bits);
+    word += increment;                                  // 0 -> 1 or 1 -> 2; never carries into the next counter.
+    bool const OR_counter_woke_up = (increment & idle & ~required_bits) != 0;
+    word_type const idle_after = idle_bits(word);
+    bool const woken_up = was_idle && (idle_after & required_bits) == 0 && (OR_counter_woke_up || idle_after == 0);
+    if (woken_up)
+      word = running_word;
+    else if (OR_counter_woke_up)
+      word |= idle_after & ~required_bits;              // Stop waiting for the other OR conditions.
+    return { word, woken_up };
+  }
+
+  static constexpr Transition wait_transition(word_type word, condition_type conditions, condition_type required)
+  {
+    word_type const required_bits = counter_bits(required);
+    word_type const waited = counter_bits(conditions);
+    // A counter at 2 goes back to 1: that condition was already signalled.
+    word_type const pre_signalled = waited & (word >> 1) & low_bits;
+    word -= waited;                                     // 1 -> 0 or 2 -> 1; never borrows (the task is running).
+    bool const OR_counter_woke_up = (pre_signalled & ~required_bits) != 0;
+    word_type idle_after = idle_bits(word);
+    if (OR_counter_woke_up)
+    {
+      if ((idle_after & required_bits) == 0)
+        word = running_word;
+      else
+        word |= idle_after & ~required_bits;
+      idle_after = idle_bits(word);
+    }
+    bool const go_idle = idle_after != 0;
+    if (!go_idle)
+      word = running_word;                              // Continue running.
+    return { word, go_idle };
+  }
+
+ private:
+  std::atomic<word_type> m_word;
+  condition_type const m_required;                      // The conditions that are AND-ed.
+
+ public:
+  ConditionWord(condition_type required = 0) : m_word(running_word), m_required(required) { }
+
+  // Signal conditions. Returns true if this woke up the task; the caller must then run it.
+  bool signal(condition_type conditions)
+  {
+    word_type word = m_word.load(std::memory_order_relaxed);
+    Transition transition;
+    do
+      transition = signal_transition(word, conditions, m_required);
+    while (!m_word.compare_exchange_weak(word, transition.m_word, std::memory_order_acq_rel, std::memory_order_relaxed));
+    return transition.m_result;
+  }
+
+  // Called by the running task. Returns true if the task must go idle; it then continues
+  // when a call to signal() returns true. Returns false if it must continue running.
+  bool wait(condition_type conditions)
+  {
+    word_type word = m_word.load(std::memory_order_relaxed);
+    Transition transition;
+    do
+    {
+      ASSERT(idle_bits(word) == 0);
+      transition = wait_transition(word, conditions, m_required);
+    }
+    while (!m_word.compare_exchange_weak(word, transition.m_word, std::memory_order_acq_rel, std::memory_order_acquire));
+    return transition.m_result;
+  }
+
+  bool is_idle() const { return idle_bits(m_word.load(std::memory_order_acquire)) != 0; }
+  word_type load() const { return m_word.load(std::memory_order_relaxed); }
+};
+
+} // namespace statefultask
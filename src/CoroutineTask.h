@@ -0,0 +1,282 @@
+#pragma once
+
+#include "statefultask/AIStatefulTask.h"
+#include "threadpool/Timer.h"
+#include "TaskArena.h"
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include "debug.h"
+
+namespace statefultask {
+
+// Write the body of an AIStatefulTask as a C++20 coroutine.
+//
+// Instead of an enum of states, state_str_impl and a multiplex_impl switch, derive from
+// CoroutineTask and implement body():
+//
+//   class MyTask : public statefultask::CoroutineTask
+//   {
+//    protected:
+//     ~MyTask() override = default;
+//     char const* task_name_impl() const override { return "MyTask"; }
+//
+//     Body body() override
+//     {
+//       boost::intrusive_ptr<Child> child = new Child;
+//       co_await run_child(child, queue_handle);           // Run child and wait until it finished.
+//       co_await wait_until(2, [this](){ return m_bumped; });      // wait(2) until m_bumped (set before signal(2)).
+//       co_await sleep_for(threadpool::Interval<10, std::chrono::milliseconds>());
+//       co_await yield_to(queue_handle);                   // Continue in a thread of the pool.
+//     }
+//   };
+//
+// The coroutine is resumed from multiplex_impl and an awaited operation maps onto the
+// usual AIStatefulTask calls: run(handler, this, condition), wait(condition), yield(handler)
+// and a threadpool::Timer that calls signal(condition). An awaited operation that is
+// already satisfied doesn't suspend at all, and a task that is woken up for a satisfied
+// operation resumes the coroutine in a loop, without going through the virtual dispatch
+// and the state bookkeeping of AIStatefulTask for every step.
+//
+// The coroutine frame is allocated with TaskArena (per-thread free lists backed by
+// AIMemoryPagePool). Returning from body() finishes the task; an exception that
+// escapes body() aborts it.
+class CoroutineTask : public AIStatefulTask
+{
+ public:
+  class Body;
+
+  struct promise_type
+  {
+    CoroutineTask* m_task = nullptr;
+    std::exception_ptr m_exception;
+
+    static void* operator new(size_t size) { return TaskArena::allocate(size); }
+    static void operator delete(void* ptr) { TaskArena::deallocate(ptr); }
+
+    Body get_return_object();
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() { }
+    void unhandled_exception() { m_exception = std::current_exception(); }
+  };
+
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  // The return type of body().
+  class Body
+  {
+   private:
+    handle_type m_handle;
+
+   public:
+    using promise_type = CoroutineTask::promise_type;
+
+    Body() = default;
+    explicit Body(handle_type handle) : m_handle(handle) { }
+    Body(Body&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) { }
+    Body& operator=(Body&& other) noexcept { if (this != &other) { reset(); m_handle = std::exchange(other.m_handle, {}); } return *this; }
+    ~Body() { reset(); }
+
+    void reset() { if (m_handle) m_handle.destroy(); m_handle = {}; }
+    handle_type handle() const { return m_handle; }
+  };
+
+ protected:
+  using direct_base_type = AIStatefulTask;
+
+  enum coroutine_task_state_type {
+    CoroutineTask_start = direct_base_type::state_end,
+    CoroutineTask_resume,
+    CoroutineTask_done
+  };
+
+ public:
+  static state_type constexpr state_end = CoroutineTask_done + 1;
+
+ private:
+  // Something that the body waits for.
+  struct Waiter
+  {
+    // signalled is true when the task was woken up by signal(condition) since it suspended on this.
+    virtual bool ready(bool signalled) const = 0;
+  };
+
+  Body m_body;
+  Waiter const* m_waiting = nullptr;                    // What the body is suspended on, if anything.
+  condition_type m_waiting_condition = 0;
+  bool m_signalled = false;                             // The task called wait(m_waiting_condition) and was woken up.
+  bool m_yielded = false;                               // The body suspended in yield_to().
+
+  void suspend_on(Waiter const* waiter, condition_type condition)
+  {
+    m_waiting = waiter;
+    m_waiting_condition = condition;
+    m_signalled = false;
+  }
+
+ public:
+  CoroutineTask(CWDEBUG_ONLY(bool debug = false)) CWDEBUG_ONLY(: AIStatefulTask(debug)) { }
+
+  // Awaitable: wait(condition) until predicate() returns true.
+  template<typename PREDICATE>
+  struct WaitUntil : Waiter
+  {
+    condition_type m_condition;
+    PREDICATE m_predicate;
+
+    WaitUntil(condition_type condition, PREDICATE predicate) : m_condition(condition), m_predicate(std::move(predicate)) { }
+    bool ready(bool) const override { return m_predicate(); }
+    bool await_ready() const { return m_predicate(); }
+    void await_suspend(handle_type handle) { handle.promise().m_task->suspend_on(this, m_condition); }
+    void await_resume() { }
+  };
+
+  // Awaitable: run child with handler and wait until it finished.
+  template<typename CHILD>
+  struct RunChild : Waiter
+  {
+    CHILD const& m_child;
+    Handler m_handler;
+    condition_type m_condition;
+
+    RunChild(CHILD const& child, Handler handler, condition_type condition) : m_child(child), m_handler(handler), m_condition(condition) { }
+    bool ready(bool) const override { return m_child->finished(); }
+    bool await_ready() const { return false; }
+    bool await_suspend(handle_type handle)
+    {
+      CoroutineTask* task = handle.promise().m_task;
+      m_child->run(m_handler, task, m_condition);
+      if (m_child->finished())
+        return false;                                   // Finished already (immediate handler): don't suspend.
+      task->suspend_on(this, m_condition);
+      return true;
+    }
+    // Returns true when the child finished successfully.
+    bool await_resume() { return !m_child->aborted(); }
+  };
+
+  // Awaitable: sleep for interval (a threadpool::Interval), then continue.
+  //
+  // The body continues only once the signal of the timer was delivered: the SleepFor is
+  // destroyed as soon as the body continues, so the timer callback must not touch it.
+  template<typename INTERVAL>
+  struct SleepFor : Waiter
+  {
+    INTERVAL m_interval;
+    condition_type m_condition;
+    threadpool::Timer m_timer;
+
+    SleepFor(INTERVAL interval, condition_type condition) : m_interval(interval), m_condition(condition) { }
+    bool ready(bool signalled) const override { return signalled; }
+    bool await_ready() const { return false; }
+    void await_suspend(handle_type handle)
+    {
+      CoroutineTask* task = handle.promise().m_task;
+      task->suspend_on(this, m_condition);
+      m_timer.start(m_interval, [task = boost::intrusive_ptr<CoroutineTask>(task), condition = m_condition](){ task->signal(condition); });
+    }
+    void await_resume() { }
+  };
+
+  // Awaitable: yield(handler) and continue the body from that handler.
+  struct YieldTo
+  {
+    Handler m_handler;
+
+    bool await_ready() const { return false; }
+    void await_suspend(handle_type handle)
+    {
+      CoroutineTask* task = handle.promise().m_task;
+      task->m_yielded = true;
+      task->yield(m_handler);
+    }
+    void await_resume() { }
+  };
+
+ protected:
+  ~CoroutineTask() override = default;
+
+  // The body of the task.
+  virtual Body body() = 0;
+
+  template<typename PREDICATE>
+  static WaitUntil<PREDICATE> wait_until(condition_type condition, PREDICATE predicate) { return { condition, std::move(predicate) }; }
+
+  template<typename CHILD>
+  static RunChild<CHILD> run_child(CHILD const& child, Handler handler, condition_type condition = 1) { return { child, handler, condition }; }
+
+  // condition must not be used for anything else while sleeping.
+  template<typename INTERVAL>
+  static SleepFor<INTERVAL> sleep_for(INTERVAL interval, condition_type condition = 1) { return { interval, condition }; }
+
+  static YieldTo yield_to(Handler handler) { return { handler }; }
+
+  char const* state_str_impl(state_type run_state) const override
+  {
+    switch (run_state)
+    {
+      AI_CASE_RETURN(CoroutineTask_start);
+      AI_CASE_RETURN(CoroutineTask_resume);
+      AI_CASE_RETURN(CoroutineTask_done);
+    }
+    return direct_base_type::state_str_impl(run_state);
+  }
+
+  void multiplex_impl(state_type run_state) override
+  {
+    switch (run_state)
+    {
+      case CoroutineTask_start:
+        m_body = body();
+        m_body.handle().promise().m_task = this;
+        set_state(CoroutineTask_resume);
+        [[fallthrough]];
+      case CoroutineTask_resume:
+      {
+        handle_type handle = m_body.handle();
+        for (;;)
+        {
+          if (m_waiting)
+          {
+            if (!m_waiting->ready(m_signalled))
+            {
+              m_signalled = true;                       // We only get here again after signal(m_waiting_condition).
+              wait(m_waiting_condition);
+              return;
+            }
+            m_waiting = nullptr;
+          }
+          m_yielded = false;
+          handle.resume();
+          if (handle.done())
+            break;
+          if (m_yielded)
+            return;                                     // Continue in the handler that was yielded to.
+        }
+        set_state(CoroutineTask_done);
+        [[fallthrough]];
+      }
+      case CoroutineTask_done:
+      {
+        std::exception_ptr exception = m_body.handle().promise().m_exception;
+        m_body.reset();
+        if (exception)
+        {
+          Dout(dc::warning, "Exception escaped from the body of " << task_name_impl() << "; aborting.");
+          abort();
+        }
+        else
+          finish();
+        break;
+      }
+    }
+  }
+};
+
+inline CoroutineTask::Body CoroutineTask::promise_type::get_return_object()
+{
+  return Body(handle_type::from_promise(*this));
+}
+
+} // namespace statefultask
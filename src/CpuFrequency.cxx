@@ -0,0 +1,161 @@
+#include "sys.h"
+#include "CpuFrequency.h"
+#include "HostCache.h"
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <thread>
+#include <limits>
+#include <string>
+#include <cpuid.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <x86intrin.h>
+#include "debug.h"
+
+namespace benchmark {
+
+//static
+std::atomic<double> CpuFrequency::s_cycles_per_second = ATOMIC_VAR_INIT(0.0);
+
+namespace {
+
+std::mutex s_calibration_mutex;
+char const* const cache_name = "tsc_frequency";
+std::chrono::milliseconds constexpr calibration_duration{500};
+
+struct Sample
+{
+  uint64_t m_tsc;
+  int64_t m_ns;
+};
+
+// Read CLOCK_MONOTONIC_RAW and the TSC at (as good as possible) the same time.
+Sample sample()
+{
+  Sample result{0, 0};
+  uint64_t best_window = std::numeric_limits<uint64_t>::max();
+  // Bracket the clock_gettime call between two TSC reads and keep the tightest bracket.
+  for (int i = 0; i < 16; ++i)
+  {
+    struct timespec ts;
+    unsigned int aux;
+    _mm_lfence();
+    uint64_t tsc1 = __rdtsc();
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    uint64_t tsc2 = __rdtscp(&aux);
+    if (tsc2 - tsc1 < best_window)
+    {
+      best_window = tsc2 - tsc1;
+      result.m_tsc = tsc1 + best_window / 2;
+      result.m_ns = ts.tv_sec * int64_t{1000000000} + ts.tv_nsec;
+    }
+  }
+  return result;
+}
+
+} // namespace
+
+//static
+bool CpuFrequency::has_invariant_tsc()
+{
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+    return false;
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  return (edx & (1U << 8));     // Advanced Power Management Information: Invariant TSC.
+}
+
+//static
+double CpuFrequency::measure(int cpu, std::chrono::milliseconds duration)
+{
+  DoutEntering(dc::notice, "CpuFrequency::measure(" << cpu << ", " << duration.count() << " ms)");
+
+  // Measure in a separate thread, so that we can pin it without changing the affinity of the caller.
+  double result = 0.0;
+  std::thread measure_thread([&](){
+    Debug(NAMESPACE_DEBUG::init_thread("TSCcalibrate"));
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) != 0)
+      Dout(dc::warning, "Could not pin TSC calibration thread to CPU #" << cpu << ".");
+
+    // Do five short measurements and use the median, which protects against being preempted during one of them.
+    std::array<double, 5> frequencies;
+    for (auto& frequency : frequencies)
+    {
+      Sample start = sample();
+      std::this_thread::sleep_for(duration / frequencies.size());
+      Sample end = sample();
+      frequency = (end.m_tsc - start.m_tsc) * 1e9 / (end.m_ns - start.m_ns);
+    }
+    std::nth_element(frequencies.begin(), frequencies.begin() + frequencies.size() / 2, frequencies.end());
+    result = frequencies[frequencies.size() / 2];
+  });
+  measure_thread.join();
+
+  Dout(dc::notice, "Measured TSC frequency: " << (result * 1e-9) << " GHz.");
+  return result;
+}
+
+//static
+double CpuFrequency::cycles_per_second()
+{
+  double cycles_per_second = s_cycles_per_second.load(std::memory_order_relaxed);
+  if (cycles_per_second != 0.0)
+    return cycles_per_second;
+
+  std::lock_guard<std::mutex> lock(s_calibration_mutex);
+  cycles_per_second = s_cycles_per_second.load(std::memory_order_relaxed);
+  if (cycles_per_second != 0.0)
+    return cycles_per_second;
+
+  HostCache cache(cache_name);
+  std::string const cpu_model = HostCache::cpu_model();
+  bool const invariant_tsc = has_invariant_tsc();
+
+  if (!invariant_tsc)
+    Dout(dc::warning, "This CPU does not have an invariant TSC: cycle counts can not reliably be converted to time!");
+  else
+  {
+    auto values = cache.load();
+    if (values["cpu_model"] == cpu_model && !values["tsc_frequency"].empty())
+    {
+      try
+      {
+        cycles_per_second = std::stod(values["tsc_frequency"]);
+      }
+      catch (std::exception const&)
+      {
+        Dout(dc::warning, "Ignoring corrupt " << cache.path());
+      }
+    }
+  }
+
+  if (cycles_per_second == 0.0)
+  {
+    cycles_per_second = measure(sched_getcpu(), calibration_duration);
+    // Only store the result if it is meaningful for a next run.
+    if (invariant_tsc)
+    {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "%.0f", cycles_per_second);
+      cache.store({ { "cpu_model", cpu_model }, { "tsc_frequency", buf } });
+    }
+  }
+
+  s_cycles_per_second.store(cycles_per_second, std::memory_order_relaxed);
+  return cycles_per_second;
+}
+
+//static
+void CpuFrequency::invalidate()
+{
+  std::lock_guard<std::mutex> lock(s_calibration_mutex);
+  s_cycles_per_second.store(0.0, std::memory_order_relaxed);
+  HostCache(cache_name).remove();
+}
+
+} // namespace benchmark
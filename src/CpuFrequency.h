@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace benchmark {
+
+// The frequency of the Time Stamp Counter (TSC), as read by benchmark::Stopwatch.
+//
+// Usage:
+//
+//   benchmark::Stopwatch stopwatch(cpu);
+//   stopwatch.calibrate_overhead(1000, 3);
+//   double tsc_frequency = benchmark::CpuFrequency::cycles_per_second();      // Call this outside the measurement.
+//   ...
+//   std::cout << benchmark::CpuFrequency::milliseconds(stopwatch.diff_cycles()) << " ms." << std::endl;
+//
+// The first call to cycles_per_second() (of the first run on a given host) measures
+// the TSC against CLOCK_MONOTONIC_RAW for half a second; the result is stored in a
+// HostCache file and subsequent runs just read it back.
+//
+// The cached value is only used when the processor has an invariant TSC (one that
+// ticks at a constant rate, independent of the current P-state / C-state); otherwise
+// a warning is printed and the value is measured again for every run.
+class CpuFrequency
+{
+ private:
+  static std::atomic<double> s_cycles_per_second;       // Zero until calibrated.
+
+ public:
+  // Return true when CPUID reports an invariant TSC.
+  static bool has_invariant_tsc();
+
+  // Measure the TSC frequency (in cycles per second) on cpu during approximately duration.
+  // Does not use or update the cache.
+  static double measure(int cpu, std::chrono::milliseconds duration);
+
+  // The TSC frequency in cycles per second (cached).
+  static double cycles_per_second();
+
+  // Forget the cached value, in memory and on disk.
+  static void invalidate();
+
+  static double cycles_per_ns() { return cycles_per_second() * 1e-9; }
+  static double seconds(uint64_t cycles) { return cycles / cycles_per_second(); }
+  static double milliseconds(uint64_t cycles) { return cycles * 1e3 / cycles_per_second(); }
+  static double microseconds(uint64_t cycles) { return cycles * 1e6 / cycles_per_second(); }
+  static double nanoseconds(uint64_t cycles) { return cycles * 1e9 / cycles_per_second(); }
+};
+
+} // namespace benchmark
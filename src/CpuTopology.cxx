@@ -0,0 +1,265 @@
+#include "sys.h"
+#include "CpuTopology.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include "debug.h"
+
+namespace benchmark {
+
+namespace {
+
+std::string const sys_cpu = "/sys/devices/system/cpu/";
+std::string const sys_node = "/sys/devices/system/node/";
+
+// Read the first line of a /sys file; returns false if the file doesn't exist.
+bool read_line(std::string const& path, std::string& line)
+{
+  std::ifstream file(path);
+  return file && std::getline(file, line);
+}
+
+int read_int(std::string const& path, int default_value)
+{
+  std::string line;
+  if (!read_line(path, line))
+    return default_value;
+  try
+  {
+    return std::stoi(line);
+  }
+  catch (std::exception const&)
+  {
+    return default_value;
+  }
+}
+
+// Return the lowest cpu in a cpu list file, or default_value.
+int read_first_cpu(std::string const& path, int default_value)
+{
+  std::string line;
+  if (!read_line(path, line))
+    return default_value;
+  std::vector<int> cpus = CpuTopology::parse_cpu_list(line);
+  return cpus.empty() ? default_value : *std::min_element(cpus.begin(), cpus.end());
+}
+
+} // namespace
+
+//static
+std::vector<int> CpuTopology::parse_cpu_list(std::string const& list)
+{
+  std::vector<int> result;
+  std::istringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ','))
+  {
+    if (range.empty() || range == "\n")
+      continue;
+    try
+    {
+      auto dash = range.find('-');
+      int first = std::stoi(range.substr(0, dash));
+      int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+      for (int cpu = first; cpu <= last; ++cpu)
+        result.push_back(cpu);
+    }
+    catch (std::exception const&)
+    {
+      Dout(dc::warning, "Could not parse cpu list \"" << list << "\".");
+      break;
+    }
+  }
+  return result;
+}
+
+CpuTopology::CpuTopology()
+{
+  DoutEntering(dc::notice, "CpuTopology::CpuTopology()");
+
+  std::string online;
+  std::vector<int> cpus;
+  if (read_line(sys_cpu + "online", online))
+    cpus = parse_cpu_list(online);
+  if (cpus.empty())
+  {
+    Dout(dc::warning, "Could not read " << sys_cpu << "online; assuming a flat topology.");
+    int n = std::max(1U, std::thread::hardware_concurrency());
+    for (int cpu = 0; cpu < n; ++cpu)
+      cpus.push_back(cpu);
+  }
+
+  // Map the NUMA nodes.
+  std::map<int, int> node_of_cpu;
+  std::string nodes;
+  if (read_line(sys_node + "online", nodes))
+    for (int node : parse_cpu_list(nodes))
+    {
+      std::string cpulist;
+      if (read_line(sys_node + "node" + std::to_string(node) + "/cpulist", cpulist))
+        for (int cpu : parse_cpu_list(cpulist))
+          node_of_cpu[cpu] = node;
+    }
+
+  std::map<std::pair<int, int>, int> unique_core_ids;   // (package_id, core_id) --> m_core_id.
+  for (int cpu : cpus)
+  {
+    std::string const topology = sys_cpu + "cpu" + std::to_string(cpu) + "/topology/";
+    int package_id = read_int(topology + "physical_package_id", 0);
+    int core_id = read_int(topology + "core_id", cpu);
+    auto ibp = unique_core_ids.emplace(std::make_pair(package_id, core_id), unique_core_ids.size());
+    // index3 is the L3 cache on all current x86 machines; fall back to the package if there is none.
+    int l3_id = read_first_cpu(sys_cpu + "cpu" + std::to_string(cpu) + "/cache/index3/shared_cpu_list", -1 - package_id);
+    auto node = node_of_cpu.find(cpu);
+    m_cpus.push_back({cpu, ibp.first->second, package_id, l3_id, node == node_of_cpu.end() ? 0 : node->second});
+  }
+
+  Dout(dc::notice, m_cpus.size() << " cpu's, " << number_of_cores() << " cores, " << number_of_packages() << " package(s), " <<
+      number_of_nodes() << " NUMA node(s).");
+}
+
+//static
+CpuTopology const& CpuTopology::instance()
+{
+  static CpuTopology const s_instance;
+  return s_instance;
+}
+
+int CpuTopology::number_of_cores() const
+{
+  std::set<int> cores;
+  for (Cpu const& cpu : m_cpus)
+    cores.insert(cpu.m_core_id);
+  return cores.size();
+}
+
+int CpuTopology::number_of_packages() const
+{
+  std::set<int> packages;
+  for (Cpu const& cpu : m_cpus)
+    packages.insert(cpu.m_package_id);
+  return packages.size();
+}
+
+int CpuTopology::number_of_nodes() const
+{
+  std::set<int> nodes;
+  for (Cpu const& cpu : m_cpus)
+    nodes.insert(cpu.m_node);
+  return nodes.size();
+}
+
+std::vector<int> CpuTopology::cpus_of_node(int node) const
+{
+  std::vector<int> result;
+  for (Cpu const& cpu : m_cpus)
+    if (cpu.m_node == node)
+      result.push_back(cpu.m_id);
+  return result;
+}
+
+std::vector<int> CpuTopology::select(Placement placement, int count) const
+{
+  // Sort all cpu's such that cpu's that are "close" to each other are adjacent.
+  std::vector<Cpu> sorted(m_cpus);
+  std::sort(sorted.begin(), sorted.end(), [](Cpu const& a, Cpu const& b){
+      return std::tie(a.m_node, a.m_package_id, a.m_l3_id, a.m_core_id, a.m_id) < std::tie(b.m_node, b.m_package_id, b.m_l3_id, b.m_core_id, b.m_id);
+  });
+
+  std::vector<int> result;
+  if (placement == smt_siblings)
+  {
+    for (Cpu const& cpu : sorted)
+      if (static_cast<int>(result.size()) < count)
+        result.push_back(cpu.m_id);
+    return result;
+  }
+
+  // Split the cpu's into the first hardware thread of every core (primaries) and the rest (siblings).
+  std::vector<Cpu> primaries;
+  std::vector<Cpu> siblings;
+  std::set<int> seen_cores;
+  for (Cpu const& cpu : sorted)
+    (seen_cores.insert(cpu.m_core_id).second ? primaries : siblings).push_back(cpu);
+
+  // Return the cpu's of list, taking them round robin from the groups formed by key.
+  auto round_robin = [](std::vector<Cpu> const& list, auto key) {
+    std::map<int, std::vector<int>> groups;
+    for (Cpu const& cpu : list)
+      groups[key(cpu)].push_back(cpu.m_id);
+    std::vector<int> ordered;
+    for (size_t i = 0; ordered.size() < list.size(); ++i)
+      for (auto const& group : groups)
+        if (i < group.second.size())
+          ordered.push_back(group.second[i]);
+    return ordered;
+  };
+
+  switch (placement)
+  {
+    case same_l3:
+    {
+      std::map<int, std::vector<int>> l3_groups;
+      for (Cpu const& cpu : primaries)
+        l3_groups[cpu.m_l3_id].push_back(cpu.m_id);
+      // Use the largest group.
+      std::vector<int> const* largest = nullptr;
+      for (auto const& group : l3_groups)
+        if (!largest || group.second.size() > largest->size())
+          largest = &group.second;
+      if (largest)
+        result = *largest;
+      break;
+    }
+    case cross_package:
+      if (number_of_packages() < 2)
+        result.push_back(primaries.front().m_id);
+      else
+        result = round_robin(primaries, [](Cpu const& cpu){ return cpu.m_package_id; });
+      break;
+    case compact:
+      for (Cpu const& cpu : primaries)
+        result.push_back(cpu.m_id);
+      for (Cpu const& cpu : siblings)
+        result.push_back(cpu.m_id);
+      break;
+    case scatter:
+    {
+      auto by_node = [](Cpu const& cpu){ return cpu.m_node; };
+      result = round_robin(primaries, by_node);
+      std::vector<int> rest = round_robin(siblings, by_node);
+      result.insert(result.end(), rest.begin(), rest.end());
+      break;
+    }
+    case smt_siblings:
+      break;
+  }
+  if (static_cast<int>(result.size()) > count)
+    result.resize(count);
+  return result;
+}
+
+//static
+char const* CpuTopology::name(Placement placement)
+{
+  switch (placement)
+  {
+    case smt_siblings:
+      return "smt_siblings";
+    case same_l3:
+      return "same_l3";
+    case cross_package:
+      return "cross_package";
+    case compact:
+      return "compact";
+    case scatter:
+      return "scatter";
+  }
+  return "unknown";
+}
+
+} // namespace benchmark
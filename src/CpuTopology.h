@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace benchmark {
+
+// The layout of the online cpu's of this machine, as read from /sys/devices/system.
+//
+// Usage:
+//
+//   auto const& topology = benchmark::CpuTopology::instance();
+//   std::vector<int> cpus = topology.select(benchmark::CpuTopology::same_l3, 4);
+//   if (cpus.size() == 4)
+//     ...                                              // Pin four threads to cpus[0] ... cpus[3].
+//
+// If /sys can't be read then every cpu is assumed to be a separate core on a single
+// package and NUMA node.
+class CpuTopology
+{
+ public:
+  struct Cpu
+  {
+    int m_id;                           // The cpu number as used by sched_setaffinity (and benchmark::Stopwatch).
+    int m_core_id;                      // Unique per physical core (not the value of core_id, which is only unique per package).
+    int m_package_id;                   // The socket.
+    int m_l3_id;                        // The lowest cpu number that shares the last level cache with this cpu.
+    int m_node;                         // The NUMA node.
+  };
+
+  enum Placement
+  {
+    smt_siblings,       // Fill all hardware threads of a core before using the next core.
+    same_l3,            // One thread per core, all cores share the last level cache (the same CCX).
+    cross_package,      // One thread per core, alternating between packages (sockets).
+    compact,            // One thread per core, filling one package (and L3) at a time; then the SMT siblings.
+    scatter             // Round robin over the NUMA nodes, one thread per core; then the SMT siblings.
+  };
+
+ private:
+  std::vector<Cpu> m_cpus;
+
+  CpuTopology();
+
+ public:
+  static CpuTopology const& instance();
+
+  std::vector<Cpu> const& cpus() const { return m_cpus; }
+  int number_of_cpus() const { return m_cpus.size(); }
+  int number_of_cores() const;
+  int number_of_packages() const;
+  int number_of_nodes() const;
+
+  // Return the cpu numbers of all online cpu's in NUMA node node.
+  std::vector<int> cpus_of_node(int node) const;
+
+  // Return count cpu numbers according to placement, or fewer if this machine doesn't
+  // have enough cpu's for that placement (for example, cross_package on a single socket
+  // machine returns at most one cpu).
+  std::vector<int> select(Placement placement, int count) const;
+
+  // Parse a cpu list like "0-3,8,10-11" (the format used in /sys).
+  static std::vector<int> parse_cpu_list(std::string const& list);
+
+  static char const* name(Placement placement);
+};
+
+} // namespace benchmark
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "threadpool/AIThreadPool.h"
+#include "threadpool/Timer.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "debug.h"
+
+namespace threadpool {
+
+// Earliest-deadline-first execution on top of an AIThreadPool queue.
+//
+// The queues of AIThreadPool are FIFOs and the only way to express urgency is to use a
+// higher priority queue. A DeadlineQueue keeps the submitted functors in a min-heap on
+// their deadline and puts, for every submitted functor, a trampoline in the pool queue.
+// A trampoline doesn't run the functor that it was submitted with but pops and runs the
+// functor with the earliest deadline at the moment it is executed. Functors with equal
+// deadlines run in the order that they were submitted.
+//
+// A functor that returns true is put back in the heap with the same deadline, and its
+// trampoline asks the pool to run it again.
+//
+// The number of functors that finished after their deadline is counted.
+//
+// Usage:
+//
+//   threadpool::DeadlineQueue deadline_queue(thread_pool, queue_handle, capacity);
+//   auto deadline = threadpool::DeadlineQueue::clock_type::now() + std::chrono::microseconds(500);
+//   if (!deadline_queue.try_submit(deadline, [](){ ...; return false; }))
+//     ;  // The pool queue is full.
+//
+// The DeadlineQueue must outlive all functors that were submitted through it, and all
+// functors of the pool queue should be submitted through it (other functors run in FIFO
+// order between the trampolines).
+class DeadlineQueue
+{
+ public:
+  using time_point = Timer::time_point;
+  using clock_type = time_point::clock;
+  using functor_type = std::function<bool()>;
+
+ private:
+  struct Entry
+  {
+    time_point m_deadline;
+    uint64_t m_sequence;
+    functor_type m_functor;
+
+    // std::push_heap builds a max-heap; the "largest" entry is the one with the earliest deadline.
+    friend bool operator<(Entry const& a, Entry const& b)
+    {
+      return a.m_deadline > b.m_deadline || (a.m_deadline == b.m_deadline && a.m_sequence > b.m_sequence);
+    }
+  };
+
+  AIThreadPool& m_thread_pool;
+  AIQueueHandle const m_queue_handle;
+  int const m_capacity;
+
+  std::mutex m_heap_mutex;
+  std::vector<Entry> m_heap;
+  uint64_t m_next_sequence = 0;
+
+  std::atomic<uint64_t> m_submitted = ATOMIC_VAR_INIT(0);
+  std::atomic<uint64_t> m_executed = ATOMIC_VAR_INIT(0);
+  std::atomic<uint64_t> m_missed = ATOMIC_VAR_INIT(0);
+  std::atomic<time_point::rep> m_max_lateness = ATOMIC_VAR_INIT(0);
+
+  void push(Entry&& entry)
+  {
+    std::lock_guard<std::mutex> lock(m_heap_mutex);
+    m_heap.push_back(std::move(entry));
+    std::push_heap(m_heap.begin(), m_heap.end());
+  }
+
+  // The body of every trampoline.
+  bool run_earliest()
+  {
+    Entry entry;
+    {
+      std::lock_guard<std::mutex> lock(m_heap_mutex);
+      // There is exactly one trampoline in the pool queue for every entry in the heap.
+      ASSERT(!m_heap.empty());
+      std::pop_heap(m_heap.begin(), m_heap.end());
+      entry = std::move(m_heap.back());
+      m_heap.pop_back();
+    }
+    bool again = entry.m_functor();
+    m_executed.fetch_add(1, std::memory_order_relaxed);
+    time_point::rep const lateness = (clock_type::now() - entry.m_deadline).count();
+    if (lateness > 0)
+    {
+      m_missed.fetch_add(1, std::memory_order_relaxed);
+      time_point::rep prev = m_max_lateness.load(std::memory_order_relaxed);
+      while (lateness > prev && !m_max_lateness.compare_exchange_weak(prev, lateness, std::memory_order_relaxed))
+        ;
+    }
+    if (again)
+      push(std::move(entry));
+    return again;
+  }
+
+ public:
+  DeadlineQueue(AIThreadPool& thread_pool, AIQueueHandle queue_handle, int capacity) :
+    m_thread_pool(thread_pool), m_queue_handle(queue_handle), m_capacity(capacity) { m_heap.reserve(capacity); }
+
+  // Add functor, which should finish before deadline. Returns false if the pool queue is full.
+  bool try_submit(time_point deadline, functor_type functor)
+  {
+    auto queues_access = m_thread_pool.queues_read_access();
+    auto& queue = m_thread_pool.get_queue(queues_access, m_queue_handle);
+    {
+      auto producer_access = queue.producer_access();
+      if (producer_access.length() >= m_capacity)
+        return false;
+      {
+        std::lock_guard<std::mutex> lock(m_heap_mutex);
+        m_heap.push_back({ deadline, m_next_sequence++, std::move(functor) });
+        std::push_heap(m_heap.begin(), m_heap.end());
+      }
+      producer_access.move_in([this](){ return run_earliest(); });
+    }
+    m_submitted.fetch_add(1, std::memory_order_relaxed);
+    queue.notify_one();
+    return true;
+  }
+
+  uint64_t submitted() const { return m_submitted.load(std::memory_order_relaxed); }
+  // The number of runs (a functor that returned true is counted once per run).
+  uint64_t executed() const { return m_executed.load(std::memory_order_relaxed); }
+  // The number of runs that finished after the deadline.
+  uint64_t missed() const { return m_missed.load(std::memory_order_relaxed); }
+  // The largest amount of time that a run finished after its deadline.
+  time_point::duration max_lateness() const { return time_point::duration(m_max_lateness.load(std::memory_order_relaxed)); }
+};
+
+} // namespace threadpool
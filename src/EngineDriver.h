@@ -0,0 +1,157 @@
+#pragma once
+
+#include "statefultask/AIEngine.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <system_error>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "debug.h"
+
+namespace statefultask {
+
+// Run an AIEngine without the polling main loop.
+//
+// The examples drive their engine with
+//
+//   while (!test_finished)
+//   {
+//     engine.mainloop();
+//     std::this_thread::sleep_for(std::chrono::milliseconds(10));
+//   }
+//
+// which adds up to 10 ms of latency to every task that continues in the engine. An
+// EngineDriver calls engine.mainloop() again immediately as long as the engine used up
+// its time slice (max_duration, the same value that was passed to the AIEngine), and
+// otherwise blocks on an eventfd until wake_up() is called, so that the engine runs
+// until it is empty and sleeps only when there is nothing to do. max_duration must be
+// larger than zero; for an AIEngine without a max_duration (which never stops early)
+// pass any value larger than the longest mainloop().
+//
+// AIEngine doesn't tell anyone that a task was added to it, so tasks that are added
+// without a wake_up() (for example a thread pool task that yields to the engine) are
+// picked up by a timeout: it starts at min_idle_wait after a wake_up() or a full time
+// slice, and doubles with every time out, up to max_idle_wait. Call wake_up() wherever
+// the application knows that the engine has work, or that the predicate of run_until
+// changed (from a callback, for example).
+//
+// Usage:
+//
+//   AIEngine engine("main engine", 2.0);
+//   statefultask::EngineDriver driver(engine, std::chrono::milliseconds(2));
+//   task->run(&engine, [&](bool success){ test_finished = true; driver.wake_up(); });
+//   driver.run_until([&](){ return test_finished; });
+class EngineDriver
+{
+ public:
+  using clock_type = std::chrono::steady_clock;
+
+  struct Config
+  {
+    std::chrono::microseconds min_idle_wait{50};
+    std::chrono::microseconds max_idle_wait{10000};
+    double full_slice = 0.9;                            // A mainloop() that used this much of max_duration is assumed to have stopped early.
+  };
+
+ private:
+  AIEngine& m_engine;
+  clock_type::duration const m_max_duration;
+  Config const m_config;
+  int m_event_fd;
+  clock_type::duration m_idle_wait;
+  double m_slice_used = 0.0;                            // Of the last mainloop().
+  uint64_t m_mainloops = 0;
+  uint64_t m_wake_ups = 0;                              // Sleeps that ended because of wake_up().
+  uint64_t m_time_outs = 0;                             // Sleeps that ended because of the time out.
+
+ public:
+  template<typename Rep, typename Period>
+  EngineDriver(AIEngine& engine, std::chrono::duration<Rep, Period> max_duration, Config const& config = {}) :
+    m_engine(engine), m_max_duration(std::chrono::duration_cast<clock_type::duration>(max_duration)), m_config(config),
+    m_event_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), m_idle_wait(config.min_idle_wait)
+  {
+    // run_once() divides by max_duration.
+    ASSERT(m_max_duration > clock_type::duration::zero());
+    if (m_event_fd == -1)
+      throw std::system_error(errno, std::generic_category(), "eventfd");
+  }
+
+  ~EngineDriver() { close(m_event_fd); }
+
+  EngineDriver(EngineDriver const&) = delete;
+  EngineDriver& operator=(EngineDriver const&) = delete;
+
+  // Wake up run_until. Thread-safe.
+  void wake_up()
+  {
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t len = write(m_event_fd, &one, sizeof(one));
+  }
+
+  // Call engine.mainloop() once. Returns true if it used up its time slice (there is probably more to do);
+  // then the idle wait starts again at min_idle_wait.
+  bool run_once()
+  {
+    auto start = clock_type::now();
+    m_engine.mainloop();
+    auto used = clock_type::now() - start;
+    ++m_mainloops;
+    m_slice_used = std::chrono::duration<double>(used) / std::chrono::duration<double>(m_max_duration);
+    if (m_slice_used < m_config.full_slice)
+      return false;
+    m_idle_wait = m_config.min_idle_wait;
+    return true;
+  }
+
+  // Block until wake_up() is called or the current idle wait expired.
+  // Returns true if woken up by wake_up().
+  bool sleep()
+  {
+    auto const wait = std::chrono::duration_cast<std::chrono::nanoseconds>(m_idle_wait);
+    struct timespec timeout = { static_cast<time_t>(wait.count() / 1000000000), static_cast<long>(wait.count() % 1000000000) };
+    struct pollfd pfd = { m_event_fd, POLLIN, 0 };
+    int ready = ppoll(&pfd, 1, &timeout, nullptr);
+    if (ready > 0)
+    {
+      uint64_t count;
+      [[maybe_unused]] ssize_t len = read(m_event_fd, &count, sizeof(count));
+      woken_up();
+      return true;
+    }
+    timed_out();
+    return false;
+  }
+
+  // The adaptive idle wait, for code that waits for event_fd() itself (see EngineInputDevice):
+  // how long to wait for a wake_up() before calling engine.mainloop() anyway.
+  clock_type::duration idle_wait() const { return m_idle_wait; }
+  // Call when event_fd() became readable (and was read): the idle wait starts again at min_idle_wait.
+  void woken_up() { ++m_wake_ups; m_idle_wait = m_config.min_idle_wait; }
+  // Call when idle_wait() expired: the next idle wait is twice as long, up to max_idle_wait.
+  void timed_out() { ++m_time_outs; m_idle_wait = std::min<clock_type::duration>(2 * m_idle_wait, m_config.max_idle_wait); }
+
+  // Run the engine until done() returns true. done() is tested before every mainloop().
+  template<typename PREDICATE>
+  void run_until(PREDICATE done)
+  {
+    while (!done())
+    {
+      if (!run_once() && !done())
+        sleep();
+    }
+  }
+
+  // The fraction of max_duration that the last mainloop() used.
+  double slice_used() const { return m_slice_used; }
+  uint64_t mainloops() const { return m_mainloops; }
+  uint64_t wake_ups() const { return m_wake_ups; }
+  uint64_t time_outs() const { return m_time_outs; }
+
+  // The file descriptor that becomes readable on wake_up().
+  int event_fd() const { return m_event_fd; }
+};
+
+} // namespace statefultask
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "evio/InputDevice.h"
+#include "EngineDriver.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <system_error>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "debug.h"
+
+namespace statefultask {
+
+// Run an AIEngine from an evio::EventLoop.
+//
+// An application that has an EventLoop doesn't need a main loop for its engine: create
+// an EngineInputDevice for the EngineDriver of the engine and the EventLoop runs the
+// engine whenever wake_up() was called, from the thread pool queue that the EventLoop
+// dispatches its input events to.
+//
+//   evio::EventLoop event_loop(low_priority_queue);
+//   AIEngine engine("main engine", 2.0);
+//   statefultask::EngineDriver engine_driver(engine, std::chrono::milliseconds(2));
+//   auto engine_device = evio::create<statefultask::EngineInputDevice>(engine_driver);
+//   engine_device->init();
+//
+//   task->run(&engine, [&](bool success){ ...; test_finished.open(); });
+//   engine_driver.wake_up();
+//   test_finished.wait();
+//   engine_device->close();
+//   event_loop.join();
+//
+// The device watches a dup() of the eventfd of the driver. Every read event clears the
+// eventfd and calls engine.mainloop() once; if that used up the time slice the device
+// calls wake_up() itself, so that the rest of the engine runs after the other ready file
+// descriptors had their turn.
+//
+// Tasks that are added to the engine without a wake_up() (for example a thread pool task
+// that yields to the engine) are picked up by a timerfd, which is armed after every
+// mainloop() that didn't use up its time slice with the adaptive idle wait of the driver:
+// min_idle_wait after a wake_up(), doubling with every time out up to max_idle_wait.
+// AIEngine doesn't tell whether it is empty, so just like EngineDriver::run_until the
+// device keeps calling mainloop() every max_idle_wait while the engine is idle.
+//
+// run_until and sleep() of the EngineDriver must not be used at the same time.
+class EngineInputDevice : public evio::InputDevice
+{
+ private:
+  // The timerfd; calls run_engine() when the idle wait expired.
+  class IdleTimer : public evio::InputDevice
+  {
+   private:
+    EngineInputDevice& m_device;
+    int m_timer_fd = -1;
+
+   public:
+    IdleTimer(EngineInputDevice& device) : m_device(device) { }
+
+    void init()
+    {
+      m_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+      if (m_timer_fd == -1)
+        throw std::system_error(errno, std::generic_category(), "timerfd_create");
+      evio::InputDevice::init(m_timer_fd);
+      start_input_device();
+    }
+
+    // (Re)start the timer; it expires once, after wait.
+    void arm(EngineDriver::clock_type::duration wait)
+    {
+      auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count();
+      ASSERT(ns > 0);                                   // Zero would disarm the timer.
+      struct itimerspec spec = { { 0, 0 }, { static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000) } };
+      timerfd_settime(m_timer_fd, 0, &spec, nullptr);
+    }
+
+    using evio::InputDevice::close;
+
+   protected:
+    void read_from_fd(int& /*allow_deletion_count*/, int fd) override
+    {
+      uint64_t expirations;
+      if (read(fd, &expirations, sizeof(expirations)) <= 0)
+        return;                                         // Re-armed after it expired, but before we got here.
+      m_device.run_engine(false);
+    }
+  };
+
+  EngineDriver& m_driver;
+  boost::intrusive_ptr<IdleTimer> m_idle_timer;
+  std::atomic_int m_requests = ATOMIC_VAR_INIT(0);      // The number of calls to run_engine() that weren't handled yet.
+  std::atomic_bool m_woken_up = ATOMIC_VAR_INIT(false); // Set when the eventfd was read.
+  std::atomic_bool m_timed_out = ATOMIC_VAR_INIT(false); // Set when the timerfd expired.
+
+  // Called from read_from_fd of both devices, which can run concurrently in different threads;
+  // only one thread at a time calls engine.mainloop() and updates the idle wait of the driver.
+  void run_engine(bool woken_up)
+  {
+    (woken_up ? m_woken_up : m_timed_out).store(true, std::memory_order_relaxed);
+    if (m_requests.fetch_add(1, std::memory_order_acq_rel) > 0)
+      return;                                           // Another thread is running the engine; it will run it again.
+    int handled;
+    bool full_slice;
+    EngineDriver::clock_type::duration idle_wait;
+    do
+    {
+      handled = m_requests.load(std::memory_order_acquire);
+      if (m_woken_up.exchange(false, std::memory_order_relaxed))
+      {
+        m_timed_out.store(false, std::memory_order_relaxed);
+        m_driver.woken_up();
+      }
+      else if (m_timed_out.exchange(false, std::memory_order_relaxed))
+        m_driver.timed_out();
+      full_slice = m_driver.run_once();
+      idle_wait = m_driver.idle_wait();
+    }
+    while (m_requests.fetch_sub(handled, std::memory_order_acq_rel) != handled);
+    if (full_slice)
+      m_driver.wake_up();
+    else
+      m_idle_timer->arm(idle_wait);
+  }
+
+ public:
+  EngineInputDevice(EngineDriver& driver) : m_driver(driver) { }
+
+  void init()
+  {
+    int fd = dup(m_driver.event_fd());
+    if (fd == -1)
+      throw std::system_error(errno, std::generic_category(), "dup");
+    m_idle_timer = evio::create<IdleTimer>(*this);
+    m_idle_timer->init();
+    evio::InputDevice::init(fd);
+    start_input_device();
+    m_idle_timer->arm(m_driver.idle_wait());
+  }
+
+  void close()
+  {
+    m_idle_timer->close();
+    evio::InputDevice::close();
+  }
+
+ protected:
+  void read_from_fd(int& /*allow_deletion_count*/, int fd) override
+  {
+    uint64_t count;
+    [[maybe_unused]] ssize_t len = read(fd, &count, sizeof(count));
+    run_engine(true);
+  }
+};
+
+} // namespace statefultask
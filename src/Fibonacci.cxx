@@ -0,0 +1,84 @@
+#include "sys.h"
+#include "Fibonacci.h"
+#include "debug.h"
+
+AIQueueHandle Fibonacci::s_queue;
+bool Fibonacci::s_inline = true;
+bool Fibonacci::s_debug = false;
+
+namespace {
+thread_local int s_inline_depth = 0;
+} // namespace
+
+char const* Fibonacci::state_str_impl(state_type run_state) const
+{
+  switch (run_state)
+  {
+    // A complete listing of fibonacci_state_type.
+    AI_CASE_RETURN(Fibonacci_start);
+    AI_CASE_RETURN(Fibonacci_wait);
+    AI_CASE_RETURN(Fibonacci_math);
+    AI_CASE_RETURN(Fibonacci_done);
+  }
+  ASSERT(false);
+  return "UNKNOWN STATE";
+}
+
+void Fibonacci::run_child(boost::intrusive_ptr<Fibonacci> const& child, bool allow_inline)
+{
+  // Let both sub tasks signal the same bit.
+  if (s_inline && allow_inline && s_inline_depth < max_inline_depth)
+  {
+    // We are about to wait anyway: run it on this thread.
+    ++s_inline_depth;
+    child->run(Handler::immediate, this, 1);
+    --s_inline_depth;
+  }
+  else
+    child->run(s_queue, this, 1);
+}
+
+void Fibonacci::multiplex_impl(state_type run_state)
+{
+  switch (run_state)
+  {
+    case Fibonacci_start:
+      // The first two Fibonacci numbers are 1.
+      if (m_index < 2)
+      {
+        m_value = 1;
+        set_state(Fibonacci_done);
+        break;
+      }
+      // Create two new task objects.
+      m_largest = new Fibonacci(m_index - 1);
+      m_smallest = new Fibonacci(m_index - 2);
+      // Start subtasks and wait for one or both to be finished.
+      run_child(m_largest, m_index <= cheap_index);
+      run_child(m_smallest, true);
+      // Wait until one or both subtasks have finished (if they haven't already).
+      set_state(Fibonacci_wait);
+      [[fallthrough]];
+    case Fibonacci_wait:
+      if (!(m_largest->finished() && m_smallest->finished()))
+      {
+        wait(1);
+        break;
+      }
+      // If we get here then both subtasks are done.
+      set_state(Fibonacci_math);
+      [[fallthrough]];
+    case Fibonacci_math:
+      // Both subtasks are done. Calculate our value from the results.
+      m_value = m_largest->value() + m_smallest->value();
+      // Free the subtree now, on this thread, instead of when the root is destroyed.
+      m_largest.reset();
+      m_smallest.reset();
+      set_state(Fibonacci_done);
+      [[fallthrough]];
+    case Fibonacci_done:
+      Dout(dc::notice(s_debug), "m_index = " << m_index << "; m_value set to " << m_value);
+      finish();
+      break;
+  }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "statefultask/AIStatefulTask.h"
+#include "threadpool/AIThreadPool.h"
+#include "TaskArena.h"
+#include "debug.h"
+
+// Compute the Fibonacci number fib(index) with one task per node of the recursion tree.
+//
+// Used by fibonacci.cxx and fibonacci_benchmark.cxx.
+//
+// Children are run directly on the current thread (work-first) instead of through
+// s_queue, as long as s_inline is set and fewer than max_inline_depth inline runs are
+// nested. Below cheap_index both children are run inline; above it only the smallest,
+// so that the largest can be picked up by another thread.
+class Fibonacci : public AIStatefulTask, public statefultask::TaskArenaAllocated
+{
+ public:
+  static int constexpr max_inline_depth = 16;
+  static int constexpr cheap_index = 12;
+
+  static AIQueueHandle s_queue;                 // The queue that the children are run in.
+  static bool s_inline;                         // Set to false to run all children through s_queue.
+  static bool s_debug;                          // Passed to AIStatefulTask and print every value (only used in debug mode).
+
+ private:
+  int m_index;
+  int m_value;
+  boost::intrusive_ptr<Fibonacci> m_smallest;
+  boost::intrusive_ptr<Fibonacci> m_largest;
+
+ protected:
+  using direct_base_type = AIStatefulTask;      // The base class of this task.
+
+  // The different states of the task.
+  enum fibonacci_state_type {
+    Fibonacci_start = direct_base_type::state_end,
+    Fibonacci_wait,
+    Fibonacci_math,
+    Fibonacci_done
+  };
+
+ public:
+  static state_type constexpr state_end = Fibonacci_done + 1;
+
+  Fibonacci(int index) : CWDEBUG_ONLY(AIStatefulTask(s_debug),) m_index(index), m_value(0) { }
+
+  int value() const { return m_value; }
+
+ protected: // The destructor must be protected.
+  ~Fibonacci() override { }
+  char const* task_name_impl() const override { return "Fibonacci"; }
+  char const* state_str_impl(state_type run_state) const override;
+  void multiplex_impl(state_type run_state) override;
+
+ private:
+  void run_child(boost::intrusive_ptr<Fibonacci> const& child, bool allow_inline);
+};
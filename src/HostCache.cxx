@@ -0,0 +1,130 @@
+#include "sys.h"
+#include "HostCache.h"
+#include <fstream>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/utsname.h>
+#include <limits.h>
+#include "debug.h"
+
+namespace benchmark {
+
+namespace {
+
+std::string trim(std::string const& str)
+{
+  auto begin = str.find_first_not_of(" \t");
+  if (begin == std::string::npos)
+    return {};
+  auto end = str.find_last_not_of(" \t");
+  return str.substr(begin, end - begin + 1);
+}
+
+} // namespace
+
+//static
+std::string HostCache::hostname()
+{
+  char buf[HOST_NAME_MAX + 1];
+  if (gethostname(buf, sizeof(buf)) != 0)
+    return "localhost";
+  buf[HOST_NAME_MAX] = 0;
+  return buf;
+}
+
+//static
+std::string HostCache::cpu_model()
+{
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line))
+  {
+    if (line.compare(0, 10, "model name") != 0)
+      continue;
+    auto colon = line.find(':');
+    if (colon != std::string::npos)
+      return trim(line.substr(colon + 1));
+  }
+  return "unknown";
+}
+
+//static
+std::string HostCache::kernel_release()
+{
+  struct utsname name;
+  if (uname(&name) != 0)
+    return "unknown";
+  return name.release;
+}
+
+//static
+std::filesystem::path HostCache::directory()
+{
+  std::filesystem::path base;
+  if (char const* xdg_cache_home = std::getenv("XDG_CACHE_HOME"); xdg_cache_home && *xdg_cache_home)
+    base = xdg_cache_home;
+  else if (char const* home = std::getenv("HOME"); home && *home)
+    base = std::filesystem::path(home) / ".cache";
+  else
+    base = std::filesystem::temp_directory_path();
+  return base / "ai-statefultask-testsuite";
+}
+
+HostCache::HostCache(std::string const& name) : m_path(directory() / (name + '.' + hostname()))
+{
+}
+
+HostCache::values_type HostCache::load() const
+{
+  values_type values;
+  std::ifstream file(m_path);
+  std::string line;
+  while (std::getline(file, line))
+  {
+    auto eq = line.find('=');
+    if (eq == std::string::npos)
+      continue;
+    values[trim(line.substr(0, eq))] = trim(line.substr(eq + 1));
+  }
+  return values;
+}
+
+bool HostCache::store(values_type const& values) const
+{
+  std::error_code ec;
+  std::filesystem::create_directories(m_path.parent_path(), ec);
+  if (ec)
+  {
+    Dout(dc::warning, "Could not create directory " << m_path.parent_path() << ": " << ec.message());
+    return false;
+  }
+  // Write to a temporary file first, so that concurrently running benchmarks never see a partial file.
+  std::filesystem::path tmp = m_path;
+  tmp += ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream file(tmp);
+    for (auto const& value : values)
+      file << value.first << " = " << value.second << '\n';
+    if (!file)
+    {
+      Dout(dc::warning, "Failed to write " << tmp);
+      return false;
+    }
+  }
+  std::filesystem::rename(tmp, m_path, ec);
+  if (ec)
+  {
+    Dout(dc::warning, "Could not rename " << tmp << " to " << m_path << ": " << ec.message());
+    std::filesystem::remove(tmp, ec);
+    return false;
+  }
+  return true;
+}
+
+void HostCache::remove() const
+{
+  std::error_code ec;
+  std::filesystem::remove(m_path, ec);
+}
+
+} // namespace benchmark
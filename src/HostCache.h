@@ -0,0 +1,46 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <string>
+
+namespace benchmark {
+
+// A small key/value file that survives between runs of the benchmarks.
+//
+// The files are stored in $XDG_CACHE_HOME/ai-statefultask-testsuite (or
+// ~/.cache/ai-statefultask-testsuite if XDG_CACHE_HOME isn't set) and
+// their name includes the hostname, so that a home directory that is
+// shared between machines (NFS) doesn't mix up calibration results.
+//
+// The format is one "key = value" pair per line.
+class HostCache
+{
+ public:
+  using values_type = std::map<std::string, std::string>;
+
+ private:
+  std::filesystem::path m_path;
+
+ public:
+  HostCache(std::string const& name);
+
+  // Return the contents of the file, or an empty map if it doesn't exist (yet).
+  values_type load() const;
+
+  // Atomically replace the file with values. Returns false if the file could not be written.
+  bool store(values_type const& values) const;
+
+  // Remove the file, if any.
+  void remove() const;
+
+  std::filesystem::path const& path() const { return m_path; }
+
+  // Information about the machine that is used to detect that a cached value is stale.
+  static std::string hostname();
+  static std::string cpu_model();
+  static std::string kernel_release();
+  static std::filesystem::path directory();
+};
+
+} // namespace benchmark
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "debug.h"
+
+namespace threadpool {
+
+// A move-only std::function replacement that stores the callable inside the object.
+//
+// std::function (libstdc++) heap-allocates every callable that is larger than two
+// pointers, so putting a lambda with a few captures into an AIObjectQueue<std::function<...>>
+// costs a malloc and a free per element. InlineFunction<R(ARGS...), size> has size bytes
+// of inline storage and, together with its two function pointers, exactly fills a
+// multiple of a cache line when size is 48 (64 bytes) or 112 (128 bytes); the object is
+// cache line aligned so that adjacent queue slots never share a cache line.
+//
+// A callable that doesn't fit (or needs a larger alignment) is a compile error, unless
+// allow_heap is true, in which case it is allocated on the heap (like std::function).
+//
+// Usage:
+//
+//   AIObjectQueue<threadpool::InlineFunction<bool()>> queue;
+//   queue.reallocate(capacity);
+//   queue.producer_access().move_in([a, b, c](){ ...; return false; });
+template<typename SIGNATURE, size_t size = 48, bool allow_heap = false>
+class InlineFunction;
+
+template<typename R, typename... ARGS, size_t size, bool allow_heap>
+class alignas(64) InlineFunction<R(ARGS...), size, allow_heap>
+{
+ public:
+  static constexpr size_t inline_size = size;
+
+  // Returns true when CALLABLE is stored inline.
+  template<typename CALLABLE>
+  static constexpr bool fits_inline =
+    sizeof(CALLABLE) <= size && alignof(CALLABLE) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<CALLABLE>;
+
+ private:
+  enum operation { move_to, destroy };
+  using invoke_type = R (*)(void* storage, ARGS&&... args);
+  using manage_type = void (*)(operation op, void* storage, void* destination);
+
+  alignas(std::max_align_t) std::byte m_storage[size];
+  invoke_type m_invoke = nullptr;
+  manage_type m_manage = nullptr;
+
+  template<typename CALLABLE>
+  static R invoke_inline(void* storage, ARGS&&... args)
+  {
+    return std::invoke(*std::launder(reinterpret_cast<CALLABLE*>(storage)), std::forward<ARGS>(args)...);
+  }
+
+  template<typename CALLABLE>
+  static void manage_inline(operation op, void* storage, void* destination)
+  {
+    CALLABLE* callable = std::launder(reinterpret_cast<CALLABLE*>(storage));
+    if (op == move_to)
+      new (destination) CALLABLE(std::move(*callable));
+    callable->~CALLABLE();
+  }
+
+  template<typename CALLABLE>
+  static R invoke_heap(void* storage, ARGS&&... args)
+  {
+    return std::invoke(**reinterpret_cast<CALLABLE**>(storage), std::forward<ARGS>(args)...);
+  }
+
+  template<typename CALLABLE>
+  static void manage_heap(operation op, void* storage, void* destination)
+  {
+    CALLABLE*& callable = *reinterpret_cast<CALLABLE**>(storage);
+    if (op == move_to)
+      *reinterpret_cast<CALLABLE**>(destination) = callable;
+    else
+      delete callable;
+  }
+
+  void move_from(InlineFunction& other) noexcept
+  {
+    if (other.m_manage)
+    {
+      other.m_manage(move_to, other.m_storage, m_storage);
+      m_invoke = other.m_invoke;
+      m_manage = other.m_manage;
+      other.m_invoke = nullptr;
+      other.m_manage = nullptr;
+    }
+  }
+
+ public:
+  InlineFunction() = default;
+  InlineFunction(std::nullptr_t) { }
+
+  template<typename CALLABLE, typename = std::enable_if_t<!std::is_same_v<std::decay_t<CALLABLE>, InlineFunction>>>
+  InlineFunction(CALLABLE&& callable)
+  {
+    using callable_type = std::decay_t<CALLABLE>;
+    static_assert(std::is_invocable_r_v<R, callable_type&, ARGS...>, "InlineFunction: callable has the wrong signature.");
+    if constexpr (fits_inline<callable_type>)
+    {
+      new (m_storage) callable_type(std::forward<CALLABLE>(callable));
+      m_invoke = &invoke_inline<callable_type>;
+      m_manage = &manage_inline<callable_type>;
+    }
+    else
+    {
+      static_assert(allow_heap, "InlineFunction: the callable does not fit in the inline storage; "
+          "reduce the captures, increase size, or set allow_heap.");
+      static_assert(sizeof(callable_type*) <= size);
+      *reinterpret_cast<callable_type**>(m_storage) = new callable_type(std::forward<CALLABLE>(callable));
+      m_invoke = &invoke_heap<callable_type>;
+      m_manage = &manage_heap<callable_type>;
+    }
+  }
+
+  InlineFunction(InlineFunction&& other) noexcept { move_from(other); }
+
+  InlineFunction& operator=(InlineFunction&& other) noexcept
+  {
+    if (this != &other)
+    {
+      reset();
+      move_from(other);
+    }
+    return *this;
+  }
+
+  InlineFunction(InlineFunction const&) = delete;
+  InlineFunction& operator=(InlineFunction const&) = delete;
+
+  ~InlineFunction() { reset(); }
+
+  void reset()
+  {
+    if (m_manage)
+    {
+      m_manage(destroy, m_storage, nullptr);
+      m_invoke = nullptr;
+      m_manage = nullptr;
+    }
+  }
+
+  explicit operator bool() const { return m_invoke != nullptr; }
+
+  R operator()(ARGS... args)
+  {
+    ASSERT(m_invoke);
+    return m_invoke(m_storage, std::forward<ARGS>(args)...);
+  }
+};
+
+} // namespace threadpool
@@ -0,0 +1,135 @@
+#include "sys.h"
+#include "LatencyCollector.h"
+#include "CpuFrequency.h"
+#include "ResultSink.h"
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include "debug.h"
+
+namespace benchmark {
+
+void LatencyHistogram::reset()
+{
+  for (auto& bucket : m_buckets)
+    bucket.store(0, std::memory_order_relaxed);
+  m_count.store(0, std::memory_order_relaxed);
+  m_sum.store(0, std::memory_order_relaxed);
+  m_min.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+  m_max.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::merge(LatencyHistogram const& other)
+{
+  if (other.count() == 0)
+    return;
+  for (int i = 0; i < number_of_buckets; ++i)
+    m_buckets[i].fetch_add(other.m_buckets[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+  m_count.fetch_add(other.count(), std::memory_order_relaxed);
+  m_sum.fetch_add(other.m_sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  if (other.min() < min())
+    m_min.store(other.min(), std::memory_order_relaxed);
+  if (other.max() > max())
+    m_max.store(other.max(), std::memory_order_relaxed);
+}
+
+double LatencyHistogram::percentile(double q) const
+{
+  uint64_t const total = count();
+  if (total == 0)
+    return 0.0;
+  // The rank of the requested value (1-based).
+  uint64_t const rank = std::max(uint64_t{1}, static_cast<uint64_t>(std::ceil(q * total)));
+  uint64_t cumulative = 0;
+  for (int i = 0; i < number_of_buckets; ++i)
+  {
+    cumulative += m_buckets[i].load(std::memory_order_relaxed);
+    if (cumulative >= rank)
+    {
+      // Return the middle of the bucket, but never something outside of [min, max].
+      double value = bucket_lower_bound(i) + 0.5 * (bucket_width(i) - 1);
+      return std::clamp(value, static_cast<double>(min()), static_cast<double>(max()));
+    }
+  }
+  return max();
+}
+
+LatencyCollector::LatencyCollector(int number_of_cpus)
+{
+  if (number_of_cpus <= 0)
+    number_of_cpus = std::thread::hardware_concurrency();
+  m_cores.reserve(number_of_cpus);
+  for (int cpu = 0; cpu < number_of_cpus; ++cpu)
+    m_cores.push_back(std::make_unique<PerCore>());
+}
+
+void LatencyCollector::merge_into(LatencyHistogram& result) const
+{
+  for (auto const& per_core : m_cores)
+    result.merge(per_core->m_histogram);
+}
+
+void LatencyCollector::reset()
+{
+  for (auto const& per_core : m_cores)
+  {
+    per_core->m_histogram.reset();
+    per_core->m_first_start_cycles.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+  }
+}
+
+namespace {
+
+double constexpr quantiles[] = { 0.5, 0.99, 0.999 };
+char const* const quantile_names[] = { "p50", "p99", "p99.9" };
+
+void print_histogram_on(std::ostream& os, std::string const& label, LatencyHistogram const& histogram)
+{
+  os << std::left << std::setw(10) << label << std::right << " n = " << std::setw(9) << histogram.count() <<
+    "  avg = " << std::setw(10) << std::fixed << std::setprecision(1) << histogram.average();
+  for (int q = 0; q < 3; ++q)
+  {
+    double cycles = histogram.percentile(quantiles[q]);
+    os << "  " << quantile_names[q] << " = " << std::setw(10) << cycles << " (" << CpuFrequency::nanoseconds(cycles) << " ns)";
+  }
+  os << "  max = " << histogram.max() << '\n';
+}
+
+void report_histogram(ResultSink& sink, std::string const& prefix, LatencyHistogram const& histogram)
+{
+  sink.value(prefix + " count", histogram.count(), "");
+  sink.value(prefix + " avg", CpuFrequency::nanoseconds(histogram.average()), "ns");
+  for (int q = 0; q < 3; ++q)
+    sink.value(prefix + ' ' + quantile_names[q], CpuFrequency::nanoseconds(histogram.percentile(quantiles[q])), "ns");
+  sink.value(prefix + " max", CpuFrequency::nanoseconds(histogram.max()), "ns");
+}
+
+} // namespace
+
+void LatencyCollector::print_on(std::ostream& os) const
+{
+  std::ios_base::fmtflags flags = os.flags();
+  std::streamsize precision = os.precision();
+  os << "Latencies in clock cycles:\n";
+  for (int cpu = 0; cpu < number_of_cpus(); ++cpu)
+    if (histogram(cpu).count() > 0)
+      print_histogram_on(os, "CPU #" + std::to_string(cpu), histogram(cpu));
+  LatencyHistogram global;
+  merge_into(global);
+  print_histogram_on(os, "All", global);
+  os.flags(flags);
+  os.precision(precision);
+}
+
+void LatencyCollector::report(ResultSink& sink, std::string const& name) const
+{
+  for (int cpu = 0; cpu < number_of_cpus(); ++cpu)
+    if (histogram(cpu).count() > 0)
+      report_histogram(sink, name + " CPU #" + std::to_string(cpu), histogram(cpu));
+  LatencyHistogram global;
+  merge_into(global);
+  report_histogram(sink, name, global);
+}
+
+} // namespace benchmark
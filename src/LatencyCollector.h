@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace benchmark {
+
+class ResultSink;
+
+// A histogram of clock cycle counts with a bounded relative error.
+//
+// Values below 32 have their own bucket; larger values are put in one of 16 buckets
+// per power of two, so that the relative error of a reported percentile is at most
+// 1/16 (and typically half of that because the middle of the bucket is returned).
+//
+// add() is lock-free and may be called concurrently; normally however every
+// thread has its own histogram (see LatencyCollector) and the relaxed atomic
+// increments don't cause any cache line bouncing.
+class LatencyHistogram
+{
+ public:
+  static constexpr int sub_bucket_bits = 4;
+  static constexpr int sub_buckets = 1 << sub_bucket_bits;
+  static constexpr int number_of_buckets = (65 - sub_bucket_bits) * sub_buckets;
+
+  // Return the index of the bucket that value belongs to.
+  static int bucket_index(uint64_t value)
+  {
+    int width = 64 - __builtin_clzll(value | 1);        // The number of significant bits in value.
+    int shift = std::max(0, width - (sub_bucket_bits + 1));
+    return shift * sub_buckets + static_cast<int>(value >> shift);
+  }
+
+  // The smallest value that belongs to bucket index.
+  static uint64_t bucket_lower_bound(int index)
+  {
+    if (index < 2 * sub_buckets)
+      return index;
+    int shift = index / sub_buckets - 1;
+    return static_cast<uint64_t>(index - shift * sub_buckets) << shift;
+  }
+
+  // The number of different values that belong to bucket index.
+  static uint64_t bucket_width(int index)
+  {
+    return index < 2 * sub_buckets ? 1 : uint64_t{1} << (index / sub_buckets - 1);
+  }
+
+ private:
+  std::array<std::atomic<uint64_t>, number_of_buckets> m_buckets;
+  std::atomic<uint64_t> m_count;
+  std::atomic<uint64_t> m_sum;
+  std::atomic<uint64_t> m_min;
+  std::atomic<uint64_t> m_max;
+
+ public:
+  LatencyHistogram() { reset(); }
+
+  // Not thread-safe.
+  void reset();
+
+  void add(uint64_t value)
+  {
+    m_buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    uint64_t prev = m_min.load(std::memory_order_relaxed);
+    while (value < prev && !m_min.compare_exchange_weak(prev, value, std::memory_order_relaxed))
+      ;
+    prev = m_max.load(std::memory_order_relaxed);
+    while (value > prev && !m_max.compare_exchange_weak(prev, value, std::memory_order_relaxed))
+      ;
+  }
+
+  // Add all counts of other to this histogram. Only call this when other is no longer being written to.
+  void merge(LatencyHistogram const& other);
+
+  uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+  uint64_t min() const { return m_min.load(std::memory_order_relaxed); }
+  uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+  double average() const { uint64_t n = count(); return n == 0 ? 0.0 : static_cast<double>(m_sum.load(std::memory_order_relaxed)) / n; }
+
+  // Return the value below which a fraction q (0 < q <= 1) of all values lie, for example 0.99 for the p99.
+  // Returns 0 when the histogram is empty.
+  double percentile(double q) const;
+};
+
+// Per-core latency statistics for a multi-threaded benchmark.
+//
+// Usage:
+//
+//   benchmark::LatencyCollector collector;
+//
+//   // In every thread:
+//   benchmark::Stopwatch stopwatch(cpu);
+//   ...
+//   stopwatch.start();
+//   // code under test.
+//   stopwatch.stop();
+//   collector.add(cpu, stopwatch);                     // Or collector.add(cpu, cycles).
+//
+//   // After joining the threads:
+//   collector.print_on(std::cout);                     // Per-core and global p50/p99/p99.9.
+//
+// Each core has its own, cache line aligned, LatencyHistogram; adding a value is
+// wait-free except for the updates of min() and max(). The global figures are
+// obtained by merging the per-core histograms after the threads finished.
+class LatencyCollector
+{
+ private:
+  struct alignas(64) PerCore
+  {
+    LatencyHistogram m_histogram;
+    std::atomic<uint64_t> m_first_start_cycles = std::numeric_limits<uint64_t>::max();
+  };
+  std::vector<std::unique_ptr<PerCore>> m_cores;
+
+ public:
+  // Create a collector for cpu's 0 through number_of_cpus - 1 (default: all cpu's).
+  LatencyCollector(int number_of_cpus = 0);
+
+  int number_of_cpus() const { return m_cores.size(); }
+
+  // Add a measurement (in clock cycles) that was done on cpu.
+  void add(int cpu, uint64_t cycles) { m_cores[cpu]->m_histogram.add(cycles); }
+
+  // Add the last measurement of stopwatch, corrected for the stopwatch overhead, and remember the start time.
+  template<typename STOPWATCH>
+  void add(int cpu, STOPWATCH& stopwatch)
+  {
+    uint64_t start_cycles = stopwatch.start_cycles();
+    uint64_t diff_cycles = stopwatch.diff_cycles();
+    diff_cycles = diff_cycles > STOPWATCH::s_stopwatch_overhead ? diff_cycles - STOPWATCH::s_stopwatch_overhead : 0;
+    PerCore& per_core = *m_cores[cpu];
+    per_core.m_histogram.add(diff_cycles);
+    uint64_t prev = per_core.m_first_start_cycles.load(std::memory_order_relaxed);
+    while (start_cycles < prev && !per_core.m_first_start_cycles.compare_exchange_weak(prev, start_cycles, std::memory_order_relaxed))
+      ;
+  }
+
+  // Access the histogram of a single cpu.
+  LatencyHistogram const& histogram(int cpu) const { return m_cores[cpu]->m_histogram; }
+
+  // The TSC value at the start of the first measurement that was added with a stopwatch on cpu.
+  uint64_t first_start_cycles(int cpu) const { return m_cores[cpu]->m_first_start_cycles.load(std::memory_order_relaxed); }
+
+  // Merge the histograms of all cpu's into result. Call this after all threads were joined.
+  void merge_into(LatencyHistogram& result) const;
+
+  // Forget everything. Not thread-safe.
+  void reset();
+
+  // Print count, average and p50/p99/p99.9 (in clock cycles and nanoseconds) for every cpu that has data, and globally.
+  void print_on(std::ostream& os) const;
+
+  // Write the same figures as value() records, with names prefixed by name.
+  void report(ResultSink& sink, std::string const& name) const;
+};
+
+} // namespace benchmark
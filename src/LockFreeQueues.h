@@ -0,0 +1,185 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include "debug.h"
+
+namespace threadpool {
+
+// Bounded lock-free alternatives for AIObjectQueue<T>.
+//
+// AIObjectQueue protects its producer side and its consumer side each with a mutex;
+// both sides read the index of the other side. Here the index that each side writes
+// is on its own cache line, next to a private copy of the other side's index that is
+// only refreshed when the queue looks full (producer) or empty (consumer). In the
+// steady state each side therefore only touches its own cache line plus the slot.
+//
+// capacity must be a power of two.
+
+// Single producer, single consumer.
+template<typename T>
+class SPSCQueue
+{
+ private:
+  struct alignas(64) Producer
+  {
+    std::atomic<size_t> m_tail = ATOMIC_VAR_INIT(0);    // Next slot to write.
+    size_t m_cached_head = 0;                           // Last seen value of Consumer::m_head.
+  };
+  struct alignas(64) Consumer
+  {
+    std::atomic<size_t> m_head = ATOMIC_VAR_INIT(0);    // Next slot to read.
+    size_t m_cached_tail = 0;                           // Last seen value of Producer::m_tail.
+  };
+
+  size_t const m_mask;
+  std::unique_ptr<std::aligned_storage_t<sizeof(T), alignof(T)>[]> m_slots;
+  Producer m_producer;
+  Consumer m_consumer;
+
+  T* slot(size_t index) { return std::launder(reinterpret_cast<T*>(&m_slots[index & m_mask])); }
+
+ public:
+  SPSCQueue(size_t capacity) : m_mask(capacity - 1), m_slots(new std::aligned_storage_t<sizeof(T), alignof(T)>[capacity])
+  {
+    ASSERT(capacity > 0 && (capacity & m_mask) == 0);
+  }
+
+  ~SPSCQueue()
+  {
+    T element;
+    while (try_pop(element))
+      ;
+  }
+
+  size_t capacity() const { return m_mask + 1; }
+
+  // Producer only. Returns false if the queue is full.
+  bool try_push(T&& element)
+  {
+    size_t const tail = m_producer.m_tail.load(std::memory_order_relaxed);
+    if (tail - m_producer.m_cached_head > m_mask)
+    {
+      m_producer.m_cached_head = m_consumer.m_head.load(std::memory_order_acquire);
+      if (tail - m_producer.m_cached_head > m_mask)
+        return false;
+    }
+    new (&m_slots[tail & m_mask]) T(std::move(element));
+    m_producer.m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Returns false if the queue is empty.
+  bool try_pop(T& element)
+  {
+    size_t const head = m_consumer.m_head.load(std::memory_order_relaxed);
+    if (head == m_consumer.m_cached_tail)
+    {
+      m_consumer.m_cached_tail = m_producer.m_tail.load(std::memory_order_acquire);
+      if (head == m_consumer.m_cached_tail)
+        return false;
+    }
+    T* ptr = slot(head);
+    element = std::move(*ptr);
+    ptr->~T();
+    m_consumer.m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+// Multiple producers, multiple consumers (Dmitry Vyukov's bounded MPMC queue).
+//
+// Every slot has a sequence number that tells whether it is ready to be written
+// (sequence == position) or read (sequence == position + 1); producers and consumers
+// claim a position with a CAS on their own, cache line padded, index.
+template<typename T>
+class MPMCQueue
+{
+ private:
+  struct Cell
+  {
+    std::atomic<size_t> m_sequence;
+    std::aligned_storage_t<sizeof(T), alignof(T)> m_storage;
+  };
+
+  size_t const m_mask;
+  std::unique_ptr<Cell[]> m_cells;
+  alignas(64) std::atomic<size_t> m_enqueue_pos = ATOMIC_VAR_INIT(0);
+  alignas(64) std::atomic<size_t> m_dequeue_pos = ATOMIC_VAR_INIT(0);
+  char m_padding[64 - sizeof(std::atomic<size_t>)];  // Keep whatever follows off the m_dequeue_pos cache line.
+
+ public:
+  MPMCQueue(size_t capacity) : m_mask(capacity - 1), m_cells(new Cell[capacity])
+  {
+    ASSERT(capacity > 1 && (capacity & m_mask) == 0);
+    for (size_t i = 0; i < capacity; ++i)
+      m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+  }
+
+  ~MPMCQueue()
+  {
+    T element;
+    while (try_pop(element))
+      ;
+  }
+
+  size_t capacity() const { return m_mask + 1; }
+
+  // Returns false if the queue is full.
+  bool try_push(T&& element)
+  {
+    size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;)
+    {
+      cell = &m_cells[pos & m_mask];
+      size_t sequence = cell->m_sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0)
+      {
+        if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+        return false;
+      else
+        pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    }
+    new (&cell->m_storage) T(std::move(element));
+    cell->m_sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns false if the queue is empty.
+  bool try_pop(T& element)
+  {
+    size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;)
+    {
+      cell = &m_cells[pos & m_mask];
+      size_t sequence = cell->m_sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0)
+      {
+        if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+        return false;
+      else
+        pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    }
+    T* ptr = std::launder(reinterpret_cast<T*>(&cell->m_storage));
+    element = std::move(*ptr);
+    ptr->~T();
+    cell->m_sequence.store(pos + m_mask + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+} // namespace threadpool
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "threadpool/AIThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "debug.h"
+
+namespace threadpool {
+
+// Grow and shrink the number of threads of an AIThreadPool with the load.
+//
+// AIThreadPool(number_of_threads, max_number_of_threads) allows the number of threads
+// to be changed later with change_number_of_threads_to(), but nothing does that
+// automatically. PoolAutoscaler runs a control thread that, every interval, puts a
+// time stamped probe functor in each registered queue. The time until a probe starts
+// running is the queue wait time of that queue; a probe that didn't run yet counts
+// with the time that it has been waiting so far, and a full queue counts as overloaded.
+//
+//   - If the wait time of any queue exceeds target_wait, the pool grows by a quarter
+//     (at least one thread), up to max_threads.
+//   - If the wait time of all queues stays below target_wait / 4 during hold_down,
+//     the pool shrinks by one thread, and again after every next hold_down period.
+//
+// The pool never shrinks below min_threads, nor below the sum of the reserved_threads
+// of all registered queues plus one: AIThreadPool reserves those threads for the
+// higher priority queues, so with fewer threads the lowest priority queue would starve.
+//
+// Usage:
+//
+//   AIThreadPool thread_pool(4, 16);
+//   AIQueueHandle high_priority_queue = thread_pool.new_queue(capacity, reserved_threads);
+//   AIQueueHandle low_priority_queue = thread_pool.new_queue(capacity);
+//   threadpool::PoolAutoscaler autoscaler(thread_pool, 4, { .min_threads = 2, .max_threads = 16 });
+//   autoscaler.add_queue(high_priority_queue, capacity, reserved_threads);
+//   autoscaler.add_queue(low_priority_queue, capacity);
+//   autoscaler.start();
+//   ...
+//   autoscaler.stop();                                 // Or let the destructor do it.
+//
+// All queues must be added before start().
+class PoolAutoscaler
+{
+ public:
+  using clock_type = std::chrono::steady_clock;
+
+  struct Config
+  {
+    int min_threads = 1;
+    int max_threads = 16;                               // Must not exceed the max_number_of_threads of the pool.
+    std::chrono::microseconds target_wait{500};
+    std::chrono::milliseconds interval{10};
+    std::chrono::milliseconds hold_down{1000};
+  };
+
+ private:
+  // Shared with the probes, which can outlive the autoscaler when the pool is busy.
+  struct Queue
+  {
+    AIQueueHandle const m_handle;
+    int const m_capacity;
+    int const m_reserved_threads;
+    std::atomic<clock_type::rep> m_probe_sent = ATOMIC_VAR_INIT(0);     // Zero when no probe is outstanding.
+    std::atomic<clock_type::rep> m_last_wait = ATOMIC_VAR_INIT(0);      // Wait time of the last probe that ran.
+
+    Queue(AIQueueHandle handle, int capacity, int reserved_threads) :
+      m_handle(handle), m_capacity(capacity), m_reserved_threads(reserved_threads) { }
+  };
+
+  AIThreadPool& m_thread_pool;
+  Config const m_config;
+  std::vector<std::shared_ptr<Queue>> m_queues;
+  std::atomic<int> m_number_of_threads;
+  int m_lower_bound;
+
+  std::thread m_thread;
+  std::mutex m_stop_mutex;
+  std::condition_variable m_stop_condition;
+  bool m_stop = false;
+
+  // Return the current wait time of queue and send a new probe if none is outstanding.
+  clock_type::duration probe(std::shared_ptr<Queue> const& queue_ptr)
+  {
+    Queue& queue = *queue_ptr;
+    clock_type::rep const now = clock_type::now().time_since_epoch().count();
+    clock_type::rep const sent = queue.m_probe_sent.load(std::memory_order_acquire);
+    if (sent != 0)
+      return clock_type::duration(now - sent);          // Still waiting.
+    clock_type::duration wait(queue.m_last_wait.load(std::memory_order_relaxed));
+    auto queues_access = m_thread_pool.queues_read_access();
+    auto& pool_queue = m_thread_pool.get_queue(queues_access, queue.m_handle);
+    {
+      auto producer_access = pool_queue.producer_access();
+      if (producer_access.length() >= queue.m_capacity)
+        return clock_type::duration::max();             // Full.
+      queue.m_probe_sent.store(now, std::memory_order_relaxed);
+      producer_access.move_in([queue_ptr](){
+          clock_type::rep const now = clock_type::now().time_since_epoch().count();
+          queue_ptr->m_last_wait.store(now - queue_ptr->m_probe_sent.load(std::memory_order_relaxed), std::memory_order_relaxed);
+          queue_ptr->m_probe_sent.store(0, std::memory_order_release);
+          return false;
+        });
+    }
+    pool_queue.notify_one();
+    return wait;
+  }
+
+  void resize(int number_of_threads)
+  {
+    Dout(dc::notice, "PoolAutoscaler: changing the number of threads from " << m_number_of_threads << " to " << number_of_threads << ".");
+    m_thread_pool.change_number_of_threads_to(number_of_threads);
+    m_number_of_threads.store(number_of_threads, std::memory_order_relaxed);
+  }
+
+  void run()
+  {
+    auto const target_wait = std::chrono::duration_cast<clock_type::duration>(m_config.target_wait);
+    clock_type::time_point idle_since{};                // The start of the current period of low wait times, or zero.
+    std::unique_lock<std::mutex> lock(m_stop_mutex);
+    while (!m_stop_condition.wait_for(lock, m_config.interval, [this](){ return m_stop; }))
+    {
+      clock_type::duration max_wait{0};
+      for (auto const& queue : m_queues)
+        max_wait = std::max(max_wait, probe(queue));
+      int const number_of_threads = m_number_of_threads.load(std::memory_order_relaxed);
+      if (max_wait > target_wait)
+      {
+        idle_since = {};
+        if (number_of_threads < m_config.max_threads)
+          resize(std::min(m_config.max_threads, number_of_threads + std::max(1, number_of_threads / 4)));
+      }
+      else if (max_wait < target_wait / 4)
+      {
+        auto const now = clock_type::now();
+        if (idle_since == clock_type::time_point{})
+          idle_since = now;
+        else if (now - idle_since >= m_config.hold_down && number_of_threads > m_lower_bound)
+        {
+          resize(number_of_threads - 1);
+          idle_since = now;
+        }
+      }
+      else
+        idle_since = {};
+    }
+  }
+
+ public:
+  // number_of_threads is the number of threads that thread_pool has now.
+  PoolAutoscaler(AIThreadPool& thread_pool, int number_of_threads, Config const& config) :
+    m_thread_pool(thread_pool), m_config(config), m_number_of_threads(number_of_threads), m_lower_bound(std::max(1, config.min_threads))
+  {
+    ASSERT(config.min_threads <= config.max_threads);
+  }
+
+  ~PoolAutoscaler() { stop(); }
+
+  void add_queue(AIQueueHandle queue_handle, int capacity, int reserved_threads = 0)
+  {
+    ASSERT(!m_thread.joinable());
+    m_queues.push_back(std::make_shared<Queue>(queue_handle, capacity, reserved_threads));
+    int total_reserved = 0;
+    for (auto const& queue : m_queues)
+      total_reserved += queue->m_reserved_threads;
+    m_lower_bound = std::max({ 1, m_config.min_threads, total_reserved + 1 });
+  }
+
+  void start()
+  {
+    m_thread = std::thread([this](){ Debug(NAMESPACE_DEBUG::init_thread("Autoscaler")); run(); });
+  }
+
+  void stop()
+  {
+    if (!m_thread.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lock(m_stop_mutex);
+      m_stop = true;
+    }
+    m_stop_condition.notify_one();
+    m_thread.join();
+  }
+
+  int number_of_threads() const { return m_number_of_threads.load(std::memory_order_relaxed); }
+  int lower_bound() const { return m_lower_bound; }
+};
+
+} // namespace threadpool
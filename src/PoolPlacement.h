@@ -0,0 +1,159 @@
+#pragma once
+
+#include "threadpool/AIThreadPool.h"
+#include "CpuTopology.h"
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "debug.h"
+
+namespace threadpool {
+
+// Pin the worker threads of an AIThreadPool according to the topology of the machine.
+//
+// AIThreadPool starts its threads without any affinity. PoolPlacement binds them
+// afterwards, from the inside: it puts one functor per worker in a queue and those
+// functors wait for each other (so that every worker thread executes exactly one
+// of them) before each calls pthread_setaffinity_np on its own thread.
+//
+// Usage:
+//
+//   AIThreadPool thread_pool(number_of_threads);
+//   // Must be the first (highest priority) queue, so that every thread may run it,
+//   // and have room for number_of_threads functors.
+//   AIQueueHandle placement_queue = thread_pool.new_queue(number_of_threads);
+//   AIQueueHandle queue = thread_pool.new_queue(capacity, reserved_threads);
+//   ...
+//   threadpool::PoolPlacement(threadpool::PoolPlacement::scatter).apply(thread_pool, placement_queue, number_of_threads);
+//
+// Note that the pool does not tie threads to queues (reserved threads are a count,
+// not a set of threads), so it is not possible to bind the reserved threads of a
+// particular queue to a particular node; use per_node to spread the workers evenly
+// over the NUMA nodes instead.
+class PoolPlacement
+{
+ public:
+  enum Policy
+  {
+    compact,            // Worker i is pinned to the i-th cpu of CpuTopology::compact.
+    scatter,            // Worker i is pinned to the i-th cpu of CpuTopology::scatter.
+    per_node,           // Worker i may run on any cpu of NUMA node i % number_of_nodes.
+    explicit_cpus       // Worker i is pinned to cpus[i % cpus.size()].
+  };
+
+ private:
+  Policy m_policy;
+  std::vector<int> m_cpus;              // Only used for explicit_cpus.
+
+ public:
+  PoolPlacement(Policy policy, std::vector<int> cpus = {}) : m_policy(policy), m_cpus(std::move(cpus)) { }
+
+  // Parse "compact", "scatter", "per_node" or a cpu list (like "0-3,8").
+  static PoolPlacement from_string(std::string const& str)
+  {
+    if (str == "compact")
+      return compact;
+    if (str == "scatter")
+      return scatter;
+    if (str == "per_node")
+      return per_node;
+    return {explicit_cpus, benchmark::CpuTopology::parse_cpu_list(str)};
+  }
+
+  // Return the cpu's that worker (0 <= worker < number_of_workers) may run on.
+  std::vector<int> cpus_for_worker(int worker, int number_of_workers) const
+  {
+    auto const& topology = benchmark::CpuTopology::instance();
+    switch (m_policy)
+    {
+      case compact:
+      case scatter:
+      {
+        std::vector<int> cpus = topology.select(m_policy == compact ? benchmark::CpuTopology::compact : benchmark::CpuTopology::scatter, number_of_workers);
+        return { cpus[worker % cpus.size()] };
+      }
+      case per_node:
+      {
+        // Nodes are not necessarily numbered consecutively.
+        std::vector<int> nodes;
+        for (auto const& cpu : topology.cpus())
+          if (std::find(nodes.begin(), nodes.end(), cpu.m_node) == nodes.end())
+            nodes.push_back(cpu.m_node);
+        std::sort(nodes.begin(), nodes.end());
+        return topology.cpus_of_node(nodes[worker % nodes.size()]);
+      }
+      case explicit_cpus:
+        if (!m_cpus.empty())
+          return { m_cpus[worker % m_cpus.size()] };
+        break;
+    }
+    return {};
+  }
+
+  // Pin number_of_workers threads of thread_pool, using the queue queue_handle.
+  // Returns the number of threads that were pinned, which is less than number_of_workers
+  // if not all threads picked up a functor within timeout (for example, because they
+  // were busy, or because the queue has a too low priority to be run by every thread).
+  int apply(AIThreadPool& thread_pool, AIQueueHandle queue_handle, int number_of_workers,
+      std::chrono::milliseconds timeout = std::chrono::milliseconds(1000)) const
+  {
+    struct State
+    {
+      std::mutex m_mutex;
+      std::condition_variable m_all_arrived;
+      std::condition_variable m_all_done;
+      int m_arrived = 0;
+      int m_done = 0;
+      int m_pinned = 0;
+      bool m_timed_out = false;
+    };
+    auto state = std::make_shared<State>();
+    std::vector<std::vector<int>> affinity(number_of_workers);
+    for (int worker = 0; worker < number_of_workers; ++worker)
+      affinity[worker] = cpus_for_worker(worker, number_of_workers);
+
+    {
+      auto queues_access = thread_pool.queues_read_access();
+      auto& queue = thread_pool.get_queue(queues_access, queue_handle);
+      {
+        auto queue_access = queue.producer_access();
+        for (int worker = 0; worker < number_of_workers; ++worker)
+          queue_access.move_in([state, cpus = affinity[worker], number_of_workers, timeout](){
+            std::unique_lock<std::mutex> lock(state->m_mutex);
+            // Wait until every worker is executing one of these functors, so that each thread is pinned exactly once.
+            if (++state->m_arrived == number_of_workers)
+              state->m_all_arrived.notify_all();
+            else if (!state->m_all_arrived.wait_for(lock, timeout, [&]{ return state->m_arrived == number_of_workers || state->m_timed_out; }))
+              state->m_timed_out = true;
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            for (int cpu : cpus)
+              CPU_SET(cpu, &cpu_set);
+            if (!cpus.empty() && pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0)
+              ++state->m_pinned;
+            else
+              Dout(dc::warning, "Failed to set the affinity of thread pool worker.");
+            ++state->m_done;
+            state->m_all_done.notify_all();
+            return false;
+          });
+      }
+      for (int worker = 0; worker < number_of_workers; ++worker)
+        queue.notify_one();
+    }
+
+    std::unique_lock<std::mutex> lock(state->m_mutex);
+    // Functors that weren't picked up before the timeout still run (and pin a thread) later.
+    state->m_all_done.wait_for(lock, 2 * timeout, [&]{ return state->m_done == number_of_workers; });
+    Dout(dc::notice, "Pinned " << state->m_pinned << " out of " << number_of_workers << " thread pool workers.");
+    return state->m_pinned;
+  }
+};
+
+} // namespace threadpool
@@ -0,0 +1,256 @@
+#pragma once
+
+#include "threadpool/AIThreadPool.h"
+#include "LatencyCollector.h"
+#include "CpuFrequency.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <type_traits>
+#include <vector>
+#include <x86intrin.h>
+
+namespace threadpool {
+
+// Counters and histograms for one AIThreadPool queue.
+//
+// AIThreadPool has no statistics of its own; threadpool.cxx reconstructs the load of a
+// queue from the number of times it was full or empty. QueueStats submits functors to
+// the queue on behalf of the caller and wraps every functor with two TSC reads, so
+// that the following is known per queue at any time:
+//
+//   - the number of functors that were added, and how often the queue was full;
+//   - the queue depth (the largest length seen by a producer, and the number of
+//     functors that were added but did not start yet);
+//   - a histogram of the time between adding a functor and the start of its execution;
+//   - a histogram of the execution time;
+//   - the time that each worker thread spent running functors of this queue.
+//
+// Usage:
+//
+//   threadpool::QueueStats stats(thread_pool, queue_handle, capacity);
+//   if (!stats.try_submit([](){ ...; return false; }))
+//     ;  // The queue was full.
+//   ...
+//   auto snapshot = stats.snapshot();                  // From any thread, at any time.
+//   snapshot.print_on(std::cout);
+//
+// The QueueStats must outlive all functors that were submitted through it.
+//
+// All updates are relaxed atomic operations on counters that are mostly written by a
+// single side: the producer counters and the consumer counters are on different cache
+// lines and every worker thread has its own busy time counter and histograms, which
+// snapshot() merges.
+class QueueStats
+{
+ public:
+  static constexpr int max_workers = 64;                // Workers beyond this share a busy time counter and histograms.
+
+  // Summary of a LatencyHistogram, in clock cycles.
+  struct Distribution
+  {
+    uint64_t count = 0;
+    double average = 0;
+    double p50 = 0;
+    double p99 = 0;
+    double p999 = 0;
+    uint64_t max = 0;
+
+    Distribution() = default;
+    Distribution(benchmark::LatencyHistogram const& histogram) :
+      count(histogram.count()), average(histogram.average()),
+      p50(histogram.percentile(0.5)), p99(histogram.percentile(0.99)), p999(histogram.percentile(0.999)),
+      max(count == 0 ? 0 : histogram.max()) { }
+
+    void print_on(std::ostream& os) const
+    {
+      using benchmark::CpuFrequency;
+      os << "{count:" << count << ", avg:" << CpuFrequency::nanoseconds(average) << " ns, p50:" << CpuFrequency::nanoseconds(p50) <<
+        " ns, p99:" << CpuFrequency::nanoseconds(p99) << " ns, p99.9:" << CpuFrequency::nanoseconds(p999) <<
+        " ns, max:" << CpuFrequency::nanoseconds(max) << " ns}";
+    }
+  };
+
+  struct Snapshot
+  {
+    uint64_t enqueued;                                  // Number of functors added to the queue.
+    uint64_t full;                                      // Number of times try_submit found the queue full.
+    uint64_t executed;                                  // Number of times a functor was run (a functor that returns true runs again).
+    uint64_t pending;                                   // Added (or rescheduled) but not started yet.
+    int max_depth;                                      // The largest queue length seen by try_submit.
+    Distribution wait;                                  // From try_submit (or the previous run) until the start of a run.
+    Distribution execution;                             // The duration of a run.
+    uint64_t elapsed_cycles;                            // Since construction or the last reset().
+    std::vector<double> utilisation;                    // Per worker: fraction of elapsed_cycles spent running functors of this queue.
+
+    void print_on(std::ostream& os) const
+    {
+      os << "enqueued:" << enqueued << ", full:" << full << ", executed:" << executed << ", pending:" << pending <<
+        ", max_depth:" << max_depth << ", wait:";
+      wait.print_on(os);
+      os << ", execution:";
+      execution.print_on(os);
+      os << ", utilisation:[";
+      char const* separator = "";
+      for (double u : utilisation)
+      {
+        os << separator << u;
+        separator = ", ";
+      }
+      os << ']';
+    }
+  };
+
+ private:
+  static inline std::atomic<uint64_t> s_next_id = ATOMIC_VAR_INIT(0);
+
+  uint64_t const m_id;                                  // Unique per object; see worker_index().
+  AIThreadPool& m_thread_pool;
+  AIQueueHandle const m_queue_handle;
+  int const m_capacity;
+
+  // Producer side.
+  alignas(64) std::atomic<uint64_t> m_enqueued;
+  std::atomic<uint64_t> m_full;
+  std::atomic<int> m_max_depth;
+
+  // Consumer side.
+  alignas(64) std::atomic<uint64_t> m_started;
+  std::atomic<uint64_t> m_rescheduled;
+  std::atomic<uint64_t> m_executed;
+
+  struct alignas(64) Worker
+  {
+    std::atomic<uint64_t> m_busy_cycles;
+    benchmark::LatencyHistogram m_wait;
+    benchmark::LatencyHistogram m_execution;
+  };
+  std::unique_ptr<Worker[]> m_workers;                  // max_workers elements; on the heap because they are large.
+  std::atomic<int> m_next_worker = ATOMIC_VAR_INIT(0);
+  std::atomic<uint64_t> m_start_cycles;
+
+  // The index of the calling thread in m_workers.
+  int worker_index()
+  {
+    // A thread can run functors of several queues; remember its index per QueueStats object.
+    // Objects are identified by m_id rather than by address, which can be reused by a later object.
+    static thread_local std::vector<std::pair<uint64_t, int>> s_indices;
+    for (auto const& entry : s_indices)
+      if (entry.first == m_id)
+        return entry.second;
+    int index = std::min(m_next_worker.fetch_add(1, std::memory_order_relaxed), max_workers - 1);
+    s_indices.emplace_back(m_id, index);
+    return index;
+  }
+
+  // Wrap functor in a lambda that stores it by value, so that the queue holds a single std::function.
+  template<typename F>
+  auto wrap(F&& functor)
+  {
+    return [this, functor = std::forward<F>(functor), enqueue_cycles = __rdtsc()]() mutable {
+      uint64_t const start_cycles = __rdtsc();
+      m_started.fetch_add(1, std::memory_order_relaxed);
+      bool again = functor();
+      uint64_t const end_cycles = __rdtsc();
+      Worker& worker = m_workers[worker_index()];
+      worker.m_wait.add(start_cycles - enqueue_cycles);
+      worker.m_execution.add(end_cycles - start_cycles);
+      worker.m_busy_cycles.fetch_add(end_cycles - start_cycles, std::memory_order_relaxed);
+      m_executed.fetch_add(1, std::memory_order_relaxed);
+      if (again)
+      {
+        // The pool runs this functor again later; that counts as a new wait.
+        m_rescheduled.fetch_add(1, std::memory_order_relaxed);
+        enqueue_cycles = end_cycles;
+      }
+      return again;
+    };
+  }
+
+ public:
+  QueueStats(AIThreadPool& thread_pool, AIQueueHandle queue_handle, int capacity) :
+    m_id(s_next_id++), m_thread_pool(thread_pool), m_queue_handle(queue_handle), m_capacity(capacity),
+    m_workers(new Worker[max_workers]) { reset(); }
+
+  // Add functor to the queue. Returns false (and counts a full event) if the queue is full.
+  // functor must be callable as bool().
+  template<typename F>
+  bool try_submit(F&& functor)
+  {
+    static_assert(std::is_invocable_r_v<bool, std::decay_t<F>&>, "try_submit requires a functor that returns bool");
+    auto queues_access = m_thread_pool.queues_read_access();
+    auto& queue = m_thread_pool.get_queue(queues_access, m_queue_handle);
+    {
+      auto producer_access = queue.producer_access();
+      int const length = producer_access.length();
+      int max_depth = m_max_depth.load(std::memory_order_relaxed);
+      while (length > max_depth && !m_max_depth.compare_exchange_weak(max_depth, length, std::memory_order_relaxed))
+        ;
+      if (length >= m_capacity)
+      {
+        m_full.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      m_enqueued.fetch_add(1, std::memory_order_relaxed);
+      producer_access.move_in(wrap(std::forward<F>(functor)));
+    }
+    queue.notify_one();
+    return true;
+  }
+
+  // The number of functors that were added (or rescheduled) but did not start yet; cheaper than snapshot().pending.
+  uint64_t pending() const
+  {
+    uint64_t const scheduled = m_enqueued.load(std::memory_order_relaxed) + m_rescheduled.load(std::memory_order_relaxed);
+    uint64_t const started = m_started.load(std::memory_order_relaxed);
+    return scheduled > started ? scheduled - started : 0;
+  }
+
+  // Read all counters and merge the histograms of the workers. The result is not an atomic
+  // snapshot: functors that run concurrently may be counted in some fields but not yet in others.
+  Snapshot snapshot() const
+  {
+    Snapshot result;
+    result.enqueued = m_enqueued.load(std::memory_order_relaxed);
+    result.full = m_full.load(std::memory_order_relaxed);
+    result.executed = m_executed.load(std::memory_order_relaxed);
+    result.pending = pending();
+    result.max_depth = m_max_depth.load(std::memory_order_relaxed);
+    result.elapsed_cycles = __rdtsc() - m_start_cycles.load(std::memory_order_relaxed);
+    int const workers = std::min(m_next_worker.load(std::memory_order_relaxed), max_workers);
+    benchmark::LatencyHistogram wait;
+    benchmark::LatencyHistogram execution;
+    for (int w = 0; w < workers; ++w)
+    {
+      Worker const& worker = m_workers[w];
+      wait.merge(worker.m_wait);
+      execution.merge(worker.m_execution);
+      result.utilisation.push_back(static_cast<double>(worker.m_busy_cycles.load(std::memory_order_relaxed)) / result.elapsed_cycles);
+    }
+    result.wait = Distribution(wait);
+    result.execution = Distribution(execution);
+    return result;
+  }
+
+  // Start counting from zero. Not thread-safe: only call this while no functors of this queue run.
+  void reset()
+  {
+    m_enqueued = 0;
+    m_full = 0;
+    m_max_depth = 0;
+    m_started = 0;
+    m_rescheduled = 0;
+    m_executed = 0;
+    for (int w = 0; w < max_workers; ++w)
+    {
+      m_workers[w].m_busy_cycles = 0;
+      m_workers[w].m_wait.reset();
+      m_workers[w].m_execution.reset();
+    }
+    m_start_cycles = __rdtsc();
+  }
+};
+
+} // namespace threadpool
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "threadpool/AIThreadPool.h"
+#include <array>
+#include <atomic>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "debug.h"
+
+namespace threadpool {
+
+// A read-mostly table of the queues of an AIThreadPool.
+//
+// Every submission does thread_pool.queues_read_access() before get_queue(), which
+// increments and decrements the reader count of a read/write lock that all submitting
+// threads share; with many threads that cache line bounces between all cores even
+// though queues are practically never added after startup.
+//
+// The QueueTable keeps an immutable array of (handle, queue pointer) pairs. A reader
+// announces itself in one of max_reader_slots cache line sized slots (selected per
+// thread), loads the current array with a single atomic load and looks the handle up.
+// new_queue() pays the full cost: it makes new readers fall back to queues_read_access(),
+// waits until all announced readers left, adds the queue to the pool (which may move
+// the existing queues), and publishes a new array.
+//
+// Usage:
+//
+//   threadpool::QueueTable queue_table(thread_pool);   // Or pass existing queue handles as second argument.
+//   AIQueueHandle handle = queue_table.new_queue(capacity);
+//   queue_table.with_queue(handle, [&](auto& queue){
+//       queue.producer_access().move_in(...);
+//       queue.notify_one();
+//     });
+//
+// Once a QueueTable exists, all queues of the pool must be created through it.
+class QueueTable
+{
+ public:
+  using queues_access_type = decltype(std::declval<AIThreadPool&>().queues_read_access());
+  using queue_type = std::remove_reference_t<decltype(std::declval<AIThreadPool&>().get_queue(std::declval<queues_access_type&>(), std::declval<AIQueueHandle>()))>;
+  static constexpr int max_reader_slots = 64;           // More threads share slots.
+
+ private:
+  struct Entry
+  {
+    AIQueueHandle m_handle;
+    queue_type* m_queue;
+  };
+  using table_type = std::vector<Entry>;
+
+  struct alignas(64) ReaderSlot
+  {
+    std::atomic<int> m_readers = ATOMIC_VAR_INIT(0);
+  };
+
+  AIThreadPool& m_thread_pool;
+  std::atomic<table_type const*> m_table;
+  std::unique_ptr<table_type const> m_current;          // Owns m_table.
+  std::atomic<bool> m_writer_pending = ATOMIC_VAR_INIT(false);
+  std::mutex m_writer_mutex;
+  std::array<ReaderSlot, max_reader_slots> m_reader_slots;
+
+  static ReaderSlot& reader_slot(QueueTable& table)
+  {
+    static std::atomic<int> s_next_slot = ATOMIC_VAR_INIT(0);
+    static thread_local int const s_slot = s_next_slot.fetch_add(1, std::memory_order_relaxed) % max_reader_slots;
+    return table.m_reader_slots[s_slot];
+  }
+
+  // Publish a new table for handles, with the current addresses of the queues.
+  // Must be called while there are no lock-free readers.
+  void publish(std::vector<AIQueueHandle> const& handles)
+  {
+    auto table = std::make_unique<table_type>();
+    {
+      auto queues_access = m_thread_pool.queues_read_access();
+      for (AIQueueHandle handle : handles)
+        table->push_back({ handle, &m_thread_pool.get_queue(queues_access, handle) });
+    }
+    m_table.store(table.get(), std::memory_order_release);
+    m_current = std::move(table);
+  }
+
+ public:
+  QueueTable(AIThreadPool& thread_pool, std::initializer_list<AIQueueHandle> existing_queues = {}) : m_thread_pool(thread_pool)
+  {
+    publish(existing_queues);
+  }
+
+  AIQueueHandle new_queue(int capacity, int reserved_threads = 0)
+  {
+    std::lock_guard<std::mutex> lock(m_writer_mutex);
+    // New readers use the locked path from now on; wait until the others left.
+    m_writer_pending.store(true, std::memory_order_seq_cst);
+    for (auto& slot : m_reader_slots)
+      while (slot.m_readers.load(std::memory_order_seq_cst) != 0)
+        std::this_thread::yield();
+    // Adding a queue may move the existing queues, so this must be done while there are no lock-free readers.
+    AIQueueHandle handle = m_thread_pool.new_queue(capacity, reserved_threads);
+    std::vector<AIQueueHandle> handles;
+    for (Entry const& entry : *m_table.load(std::memory_order_relaxed))
+      handles.push_back(entry.m_handle);
+    handles.push_back(handle);
+    // A reader that announced itself after the wait above sees m_writer_pending and doesn't
+    // load m_table, so nobody uses the old table anymore.
+    publish(handles);
+    m_writer_pending.store(false, std::memory_order_seq_cst);
+    return handle;
+  }
+
+  // Call f(queue) with the queue that belongs to handle; the queue may only be used inside f,
+  // and f may not call new_queue.
+  template<typename F>
+  decltype(auto) with_queue(AIQueueHandle handle, F&& f)
+  {
+    ReaderSlot& slot = reader_slot(*this);
+    slot.m_readers.fetch_add(1, std::memory_order_seq_cst);
+    if (AI_LIKELY(!m_writer_pending.load(std::memory_order_seq_cst)))
+    {
+      for (Entry const& entry : *m_table.load(std::memory_order_acquire))
+        if (entry.m_handle == handle)
+        {
+          struct Leave { ReaderSlot& m_slot; ~Leave() { m_slot.m_readers.fetch_sub(1, std::memory_order_release); } } leave{slot};
+          return std::forward<F>(f)(*entry.m_queue);
+        }
+    }
+    slot.m_readers.fetch_sub(1, std::memory_order_release);
+    // Slow path, while a queue is being added (or for a queue that wasn't added through this table).
+    auto queues_access = m_thread_pool.queues_read_access();
+    return std::forward<F>(f)(m_thread_pool.get_queue(queues_access, handle));
+  }
+};
+
+} // namespace threadpool
@@ -0,0 +1,361 @@
+#include "ResultSink.h"
+#include "cwds/gnuplot_tools.h"
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// Note: this file doesn't include sys.h or debug.h, so that it can be compiled together
+// with the stand-alone test programs that don't use libcwd (mutex_test.cxx and core.cc).
+
+namespace benchmark {
+
+namespace {
+
+class GnuplotSink : public ResultSink
+{
+ private:
+  std::string m_title;
+  std::string m_xlabel;
+  std::string m_ylabel;
+  std::unique_ptr<eda::Plot> m_plot;
+  std::unique_ptr<eda::PlotHistogram> m_histogram;
+  std::vector<std::string> m_commands;
+  std::string m_header;
+
+  eda::Plot& plot()
+  {
+    if (!m_plot)
+      m_plot = std::make_unique<eda::Plot>(m_title, m_xlabel, m_ylabel);
+    return *m_plot;
+  }
+
+  eda::PlotHistogram& histogram()
+  {
+    if (!m_histogram)
+      m_histogram = std::make_unique<eda::PlotHistogram>(m_title, m_xlabel, m_ylabel);
+    return *m_histogram;
+  }
+
+ public:
+  void begin(std::string const& title, std::string const& xlabel, std::string const& ylabel) override
+  {
+    m_title = title;
+    m_xlabel = xlabel;
+    m_ylabel = ylabel;
+    m_plot.reset();
+    m_histogram.reset();
+    m_commands.clear();
+    m_header.clear();
+  }
+
+  void gnuplot_header(std::string const& header) override
+  {
+    m_header = header;
+  }
+
+  void gnuplot_command(std::string const& command) override
+  {
+    // Postpone until we know what kind of plot this is.
+    m_commands.push_back(command);
+  }
+
+  void data_point(double x, double y, double dy, std::string const& series) override
+  {
+    plot().add_data_point(x, y, dy, series);
+  }
+
+  void histogram_bin(double x, double count, std::string const& series) override
+  {
+    histogram().add_data_point(x, count, series);
+  }
+
+  // There is nothing to plot for these; just print them.
+  void value(std::string const& name, double value, std::string const& unit) override
+  {
+    std::cout << name << ": " << value << ' ' << unit << std::endl;
+  }
+
+  void min_avg_max(std::string const& name, double min, double avg, double max, long count) override
+  {
+    std::cout << name << ": min/avg/max = " << min << '/' << avg << '/' << max << " (" << count << " samples)." << std::endl;
+  }
+
+  void confidence_interval(std::string const& name, double mean, double half_width, double confidence) override
+  {
+    std::cout << name << ": " << mean << " ± " << half_width << " (" << confidence << "% confidence interval)." << std::endl;
+  }
+
+  void end(std::string const& style) override
+  {
+    if (m_plot)
+    {
+      for (auto const& command : m_commands)
+        m_plot->add(command);
+      if (!m_header.empty())
+        m_plot->set_header(m_header);
+      if (m_plot->has_data())
+        m_plot->show(style);
+    }
+    if (m_histogram)
+    {
+      for (auto const& command : m_commands)
+        m_histogram->add(command);
+      m_histogram->show();
+    }
+    m_plot.reset();
+    m_histogram.reset();
+    m_commands.clear();
+    m_header.clear();
+  }
+};
+
+// Common base class of the machine readable backends.
+class StreamSink : public ResultSink
+{
+ protected:
+  std::unique_ptr<std::ostream> m_owned_stream;
+  std::ostream& m_os;
+  std::string m_title;
+
+ public:
+  StreamSink(std::ostream& os) : m_os(os) { m_os << std::setprecision(10); }
+  StreamSink(std::unique_ptr<std::ostream> os) : m_owned_stream(std::move(os)), m_os(*m_owned_stream) { m_os << std::setprecision(10); }
+
+  void begin(std::string const& title, std::string const& /*xlabel*/, std::string const& /*ylabel*/) override
+  {
+    m_title = title;
+  }
+
+  void end(std::string const& /*style*/) override
+  {
+    m_title.clear();
+    m_os.flush();
+  }
+};
+
+// Write one JSON object per line (JSON Lines).
+class JsonSink : public StreamSink
+{
+ private:
+  // A double as a JSON value: JSON has no NaN or infinity, write those as null.
+  struct Number
+  {
+    double m_value;
+
+    friend std::ostream& operator<<(std::ostream& os, Number number)
+    {
+      if (std::isfinite(number.m_value))
+        os << number.m_value;
+      else
+        os << "null";
+      return os;
+    }
+  };
+
+  static std::string quote(std::string const& str)
+  {
+    std::ostringstream ss;
+    ss << '"';
+    for (char c : str)
+    {
+      switch (c)
+      {
+        case '"':
+          ss << "\\\"";
+          break;
+        case '\\':
+          ss << "\\\\";
+          break;
+        case '\n':
+          ss << "\\n";
+          break;
+        case '\t':
+          ss << "\\t";
+          break;
+        default:
+          if (static_cast<unsigned char>(c) < 0x20)
+            ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c;
+          else
+            ss << c;
+      }
+    }
+    ss << '"';
+    return ss.str();
+  }
+
+  void record(char const* type)
+  {
+    m_os << "{\"type\":\"" << type << "\",\"plot\":" << quote(m_title);
+  }
+
+ public:
+  using StreamSink::StreamSink;
+
+  void begin(std::string const& title, std::string const& xlabel, std::string const& ylabel) override
+  {
+    StreamSink::begin(title, xlabel, ylabel);
+    record("begin");
+    m_os << ",\"xlabel\":" << quote(xlabel) << ",\"ylabel\":" << quote(ylabel) << "}\n";
+  }
+
+  void data_point(double x, double y, double dy, std::string const& series) override
+  {
+    record("point");
+    m_os << ",\"series\":" << quote(series) << ",\"x\":" << Number{x} << ",\"y\":" << Number{y} << ",\"dy\":" << Number{dy} << "}\n";
+  }
+
+  void histogram_bin(double x, double count, std::string const& series) override
+  {
+    record("bin");
+    m_os << ",\"series\":" << quote(series) << ",\"x\":" << Number{x} << ",\"count\":" << Number{count} << "}\n";
+  }
+
+  void value(std::string const& name, double value, std::string const& unit) override
+  {
+    record("value");
+    m_os << ",\"name\":" << quote(name) << ",\"value\":" << Number{value} << ",\"unit\":" << quote(unit) << "}\n";
+  }
+
+  void min_avg_max(std::string const& name, double min, double avg, double max, long count) override
+  {
+    record("min_avg_max");
+    m_os << ",\"name\":" << quote(name) << ",\"min\":" << Number{min} << ",\"avg\":" << Number{avg} << ",\"max\":" << Number{max} << ",\"count\":" << count << "}\n";
+  }
+
+  void confidence_interval(std::string const& name, double mean, double half_width, double confidence) override
+  {
+    record("confidence_interval");
+    m_os << ",\"name\":" << quote(name) << ",\"mean\":" << Number{mean} << ",\"half_width\":" << Number{half_width} << ",\"confidence\":" << Number{confidence} << "}\n";
+  }
+
+  void end(std::string const& style) override
+  {
+    record("end");
+    m_os << "}\n";
+    StreamSink::end(style);
+  }
+};
+
+// Write a single table with a fixed set of columns; unused columns are left empty.
+class CsvSink : public StreamSink
+{
+ private:
+  static std::string quote(std::string const& str)
+  {
+    if (str.find_first_of(",\"\n") == std::string::npos)
+      return str;
+    std::string result = "\"";
+    for (char c : str)
+    {
+      if (c == '"')
+        result += '"';
+      result += c;
+    }
+    return result + '"';
+  }
+
+  void record(char const* type, std::string const& name)
+  {
+    m_os << type << ',' << quote(m_title) << ',' << quote(name);
+  }
+
+ public:
+  CsvSink(std::ostream& os) : StreamSink(os) { header(); }
+  CsvSink(std::unique_ptr<std::ostream> os) : StreamSink(std::move(os)) { header(); }
+
+  void header()
+  {
+    m_os << "type,plot,name,x,y,dy,count,min,avg,max,mean,half_width,confidence,value,unit\n";
+  }
+
+  void data_point(double x, double y, double dy, std::string const& series) override
+  {
+    record("point", series);
+    m_os << ',' << x << ',' << y << ',' << dy << ",,,,,,,,,\n";
+  }
+
+  void histogram_bin(double x, double count, std::string const& series) override
+  {
+    record("bin", series);
+    m_os << ',' << x << ",,," << count << ",,,,,,,,\n";
+  }
+
+  void value(std::string const& name, double value, std::string const& unit) override
+  {
+    record("value", name);
+    m_os << ",,,,,,,,,,," << value << ',' << quote(unit) << '\n';
+  }
+
+  void min_avg_max(std::string const& name, double min, double avg, double max, long count) override
+  {
+    record("min_avg_max", name);
+    m_os << ",,,," << count << ',' << min << ',' << avg << ',' << max << ",,,,,\n";
+  }
+
+  void confidence_interval(std::string const& name, double mean, double half_width, double confidence) override
+  {
+    record("confidence_interval", name);
+    m_os << ",,,,,,,," << mean << ',' << half_width << ',' << confidence << ",,\n";
+  }
+};
+
+template<typename SINK>
+std::unique_ptr<ResultSink> create_stream_sink()
+{
+  char const* file_name = std::getenv("BENCHMARK_OUTPUT_FILE");
+  if (!file_name || !*file_name)
+    return std::make_unique<SINK>(std::cout);
+  auto file = std::make_unique<std::ofstream>(file_name);
+  if (!*file)
+  {
+    std::cerr << "Could not open BENCHMARK_OUTPUT_FILE \"" << file_name << "\", writing to std::cout instead." << std::endl;
+    return std::make_unique<SINK>(std::cout);
+  }
+  return std::make_unique<SINK>(std::move(file));
+}
+
+} // namespace
+
+//static
+std::unique_ptr<ResultSink> ResultSink::create()
+{
+  std::string output;
+  if (char const* env = std::getenv("BENCHMARK_OUTPUT"))
+    output = env;
+  else
+  {
+    char const* display = std::getenv("DISPLAY");
+    output = (display && *display) ? "gnuplot" : "json";
+  }
+  if (output == "json")
+    return create_stream_sink<JsonSink>();
+  if (output == "csv")
+    return create_stream_sink<CsvSink>();
+  if (output != "gnuplot")
+    std::cerr << "Unknown BENCHMARK_OUTPUT \"" << output << "\", using gnuplot." << std::endl;
+  return create_gnuplot();
+}
+
+//static
+std::unique_ptr<ResultSink> ResultSink::create_gnuplot()
+{
+  return std::make_unique<GnuplotSink>();
+}
+
+//static
+std::unique_ptr<ResultSink> ResultSink::create_json(std::ostream& os)
+{
+  return std::make_unique<JsonSink>(os);
+}
+
+//static
+std::unique_ptr<ResultSink> ResultSink::create_csv(std::ostream& os)
+{
+  return std::make_unique<CsvSink>(os);
+}
+
+} // namespace benchmark
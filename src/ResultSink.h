@@ -0,0 +1,65 @@
+#pragma once
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+
+namespace benchmark {
+
+// Destination of benchmark results.
+//
+// The benchmarks used to push their data straight into eda::Plot, which requires a display.
+// Instead they now write to a ResultSink, of which the gnuplot window is just one implementation.
+// The same data can be written as JSON Lines or CSV, so that results can be compared between
+// runs (or library versions) on a headless machine.
+//
+// Usage:
+//
+//   auto sink = benchmark::ResultSink::create();       // Backend selected by the environment, see create().
+//   sink->begin("Title", "x label", "y label");
+//   sink->gnuplot_command("set tics out");              // Ignored by the machine readable backends.
+//   sink->data_point(x, y, dy, "series");
+//   sink->end("points");                                // Show the plot (gnuplot), or flush the records.
+//
+// Data can also be written outside of a begin()/end() pair, in which case the plot title is empty.
+class ResultSink
+{
+ public:
+  virtual ~ResultSink() = default;
+
+  // Start a new plot (or table).
+  virtual void begin(std::string const& title, std::string const& xlabel, std::string const& ylabel) = 0;
+  // A gnuplot specific command, like "set xtics 5".
+  virtual void gnuplot_command(std::string const& /*command*/) { }
+  // The gnuplot plot modifier, like "smooth freq" or "using 1:2" (see eda::Plot::set_header).
+  virtual void gnuplot_header(std::string const& /*header*/) { }
+  // Add a (x, y) point with error (or color) dy to series.
+  virtual void data_point(double x, double y, double dy, std::string const& series) = 0;
+  // Add one bin of a histogram.
+  virtual void histogram_bin(double x, double count, std::string const& series) = 0;
+  // A single value, like the result of a FrequencyCounter.
+  virtual void value(std::string const& name, double value, std::string const& unit) = 0;
+  // The statistics of an eda::MinAvgMax.
+  virtual void min_avg_max(std::string const& name, double min, double avg, double max, long count) = 0;
+  // The mean of a series of measurements and the half width of its confidence interval (in percent).
+  virtual void confidence_interval(std::string const& name, double mean, double half_width, double confidence) = 0;
+  // Finish the current plot; style is the gnuplot style ("points", "boxes", ...).
+  virtual void end(std::string const& style) = 0;
+
+  // Convenience function for eda::MinAvgMax<T>.
+  template<typename MAM>
+  void min_avg_max(std::string const& name, MAM const& mam) { min_avg_max(name, mam.min(), mam.avg(), mam.max(), mam.count()); }
+
+  // Create the backend that was selected with the environment variable BENCHMARK_OUTPUT,
+  // which can be "gnuplot", "json" or "csv". If BENCHMARK_OUTPUT isn't set then gnuplot
+  // is used when DISPLAY is set and json otherwise.
+  //
+  // The machine readable backends write to the file BENCHMARK_OUTPUT_FILE, or std::cout
+  // when that isn't set.
+  static std::unique_ptr<ResultSink> create();
+  static std::unique_ptr<ResultSink> create_gnuplot();
+  static std::unique_ptr<ResultSink> create_json(std::ostream& os);
+  static std::unique_ptr<ResultSink> create_csv(std::ostream& os);
+};
+
+} // namespace benchmark
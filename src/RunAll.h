@@ -0,0 +1,133 @@
+#pragma once
+
+#include "statefultask/AIStatefulTask.h"
+#include "threadpool/AIThreadPool.h"
+#include "BatchSubmit.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "debug.h"
+
+namespace statefultask {
+
+namespace detail {
+
+// The shared state of one run_all call.
+class RunAll : public std::enable_shared_from_this<RunAll>
+{
+ private:
+  std::vector<boost::intrusive_ptr<AIStatefulTask>> m_tasks;    // Released as soon as a task is started (it keeps itself alive while running).
+  size_t const m_size;
+  std::atomic<size_t> m_next;                           // Index of the next task to start.
+  std::atomic<size_t> m_remaining;                      // Number of tasks that didn't finish yet.
+  std::atomic<bool> m_success;
+  AIStatefulTask::Handler const m_handler;              // The handler that the tasks are run with.
+  std::function<void(bool)> m_callback;
+  std::shared_ptr<RunAll> m_self;                       // Keeps this object alive until the last task finished.
+
+  void task_finished(bool success)
+  {
+    if (!success)
+      m_success.store(false, std::memory_order_relaxed);
+    if (m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+      auto self = std::move(m_self);                    // Destroy this object (if nothing else holds on to it) after calling m_callback.
+      m_callback(m_success.load(std::memory_order_relaxed));
+    }
+  }
+
+  // Start task i. The call back of the task only needs a raw pointer, see m_self.
+  void start(size_t i)
+  {
+    boost::intrusive_ptr<AIStatefulTask> task = std::move(m_tasks[i]);
+    task->run(m_handler, [this](bool success){ task_finished(success); });
+  }
+
+ public:
+  RunAll(std::vector<boost::intrusive_ptr<AIStatefulTask>>&& tasks, AIStatefulTask::Handler handler, std::function<void(bool)>&& callback) :
+    m_tasks(std::move(tasks)), m_size(m_tasks.size()), m_next(0), m_remaining(m_size), m_success(true), m_handler(handler), m_callback(std::move(callback)) { }
+
+  size_t size() const { return m_size; }
+
+  // Call this once, before starting any task.
+  void keep_alive() { m_self = shared_from_this(); }
+
+  // Start the next task from the current thread. Returns true when there are more tasks to start.
+  bool start_next()
+  {
+    size_t i = m_next.fetch_add(1, std::memory_order_relaxed);
+    if (i >= m_size)
+      return false;
+    start(i);
+    return i + 1 < m_size;
+  }
+
+  // Start all tasks that weren't started yet, one by one.
+  void start_remaining()
+  {
+    for (size_t i = m_next.exchange(m_size, std::memory_order_relaxed); i < m_size; ++i)
+      start(i);
+  }
+};
+
+} // namespace detail
+
+// Run all tasks in range through the thread pool queue handler, and call callback once
+// when all of them finished. The argument of callback is true if all tasks finished
+// successfully and false if one or more were aborted.
+//
+// Calling run(handler, callback) for each task from the calling thread takes the
+// producer lock of the queue and wakes up a thread once per task, serialized in that
+// one thread. run_all adds up to one functor per hardware thread to the queue, with a
+// single producer_access() and one notify_one() per functor (see
+// threadpool::submit_batch). Each of those functors calls run(handler, ...) for the next
+// task of the batch, from the worker that runs it, and returns true (run again) until
+// the batch is exhausted; so the tasks are started by all workers in parallel and the
+// calling thread returns immediately.
+//
+// Note that run(handler, ...) itself still moves every task into the queue (a task with
+// a thread pool handler can't be run in the current thread and continue in handler
+// after a wait()); what run_all saves is the serialization of those enqueues in the
+// calling thread. See the run_all cases of benchmark_suite for the comparison with the
+// plain loop.
+//
+// The tasks are run with handler, exactly as with run(handler, callback): a task that
+// calls wait() continues in handler after it is signalled.
+//
+// If the queue is full, the tasks are started one by one with run(handler, ...) from
+// the calling thread.
+//
+// Usage:
+//
+//   utils::threading::Gate all_finished;
+//   statefultask::run_all(tasks, queue_handle, [&](bool success){ all_finished.open(); });
+//   all_finished.wait();
+template<typename RANGE>
+void run_all(RANGE const& range, AIQueueHandle handler, std::function<void(bool)> callback)
+{
+  std::vector<boost::intrusive_ptr<AIStatefulTask>> tasks;
+  for (auto const& task : range)
+    tasks.emplace_back(task);
+  if (tasks.empty())
+  {
+    callback(true);
+    return;
+  }
+  auto run_all = std::make_shared<detail::RunAll>(std::move(tasks), handler, std::move(callback));
+  run_all->keep_alive();
+  int const starters = static_cast<int>(std::min(run_all->size(), static_cast<size_t>(std::max(1U, std::thread::hardware_concurrency()))));
+  int added;
+  {
+    AIThreadPool& thread_pool = AIThreadPool::instance();
+    auto queues_access = thread_pool.queues_read_access();
+    auto& queue = thread_pool.get_queue(queues_access, handler);
+    added = threadpool::submit_batch(queue, queue.capacity(), starters, [&](int){ return [run_all](){ return run_all->start_next(); }; }, starters);
+  }
+  if (added == 0)
+    run_all->start_remaining();
+}
+
+} // namespace statefultask
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace threadpool {
+
+// An unbounded single-producer/single-consumer FIFO made of fixed size segments.
+//
+// push() and pop() are lock-free: the producer only writes to the tail segment and
+// publishes each element with a release store of the segment's write count; the
+// consumer only reads from the head segment and frees a segment once it is empty and
+// a next segment exists. Memory is allocated once per segment_size elements.
+//
+// Several producers (or consumers) may use the same SpillList if they serialize their
+// accesses among themselves, for example by holding the producer (or consumer) lock of
+// the AIObjectQueue that the list is an overflow of (see SpillingObjectQueue).
+template<typename T, int segment_size = 64>
+class SpillList
+{
+ private:
+  struct Segment
+  {
+    alignas(T) std::byte m_storage[segment_size][sizeof(T)];
+    std::atomic<int> m_written = ATOMIC_VAR_INIT(0);    // Number of elements constructed (producer).
+    std::atomic<Segment*> m_next = ATOMIC_VAR_INIT(nullptr);
+    int m_read = 0;                                     // Number of elements moved out (consumer).
+
+    T* slot(int index) { return std::launder(reinterpret_cast<T*>(m_storage[index])); }
+  };
+
+  alignas(64) Segment* m_head;                          // Consumer.
+  alignas(64) Segment* m_tail;                          // Producer.
+
+ public:
+  SpillList() : m_head(new Segment), m_tail(m_head) { }
+
+  ~SpillList()
+  {
+    T value;
+    while (pop(value))
+      ;
+    delete m_head;
+  }
+
+  SpillList(SpillList const&) = delete;
+  SpillList& operator=(SpillList const&) = delete;
+
+  // Producer only.
+  void push(T&& value)
+  {
+    int index = m_tail->m_written.load(std::memory_order_relaxed);
+    if (index == segment_size)
+    {
+      Segment* segment = new Segment;
+      m_tail->m_next.store(segment, std::memory_order_release);
+      m_tail = segment;
+      index = 0;
+    }
+    new (m_tail->m_storage[index]) T(std::move(value));
+    m_tail->m_written.store(index + 1, std::memory_order_release);
+  }
+
+  // Consumer only. Returns false if the list is empty.
+  bool pop(T& value)
+  {
+    if (m_head->m_read == segment_size)
+    {
+      Segment* next = m_head->m_next.load(std::memory_order_acquire);
+      if (!next)
+        return false;
+      delete m_head;
+      m_head = next;
+    }
+    if (m_head->m_read == m_head->m_written.load(std::memory_order_acquire))
+      return false;
+    T* element = m_head->slot(m_head->m_read++);
+    value = std::move(*element);
+    element->~T();
+    return true;
+  }
+};
+
+} // namespace threadpool
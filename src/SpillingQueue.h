@@ -0,0 +1,162 @@
+#pragma once
+
+#include "threadpool/AIObjectQueue.h"
+#include "threadpool/AIThreadPool.h"
+#include "SpillList.h"
+#include <atomic>
+#include <functional>
+#include <utility>
+
+namespace threadpool {
+
+// An AIObjectQueue<T> that never refuses an element.
+//
+// When the ring buffer is full, elements are appended to a SpillList instead. As long
+// as the spill list is not empty, new elements are appended to the spill list too, so
+// that every element in the ring is older than every spilled element; the consumer
+// empties the ring first and then the spill list, and the order of move_in is kept.
+//
+// Producers are serialized by the producer lock of the ring and the (single) consumer
+// by its consumer lock; those are the two sides of the SpillList.
+//
+// Usage:
+//
+//   threadpool::SpillingObjectQueue<F> queue;
+//   queue.reallocate(capacity);
+//   queue.move_in(std::move(f));                       // Never fails.
+//   F g;
+//   if (queue.move_out(g))
+//     g();
+template<typename T>
+class SpillingObjectQueue
+{
+ private:
+  AIObjectQueue<T> m_ring;
+  SpillList<T> m_spill;
+  std::atomic<size_t> m_spill_size = ATOMIC_VAR_INIT(0);
+
+ public:
+  void reallocate(int capacity) { m_ring.reallocate(capacity); }
+  int capacity() const { return m_ring.capacity(); }
+
+  // The number of elements that did not fit in the ring buffer and were not consumed yet.
+  size_t spilled() const { return m_spill_size.load(std::memory_order_relaxed); }
+
+  void move_in(T&& element)
+  {
+    auto producer_access = m_ring.producer_access();
+    if (m_spill_size.load(std::memory_order_acquire) == 0 && producer_access.length() < m_ring.capacity())
+      producer_access.move_in(std::move(element));
+    else
+    {
+      m_spill.push(std::move(element));
+      m_spill_size.fetch_add(1, std::memory_order_release);
+    }
+  }
+
+  // Returns false if the queue is empty.
+  bool move_out(T& element)
+  {
+    auto consumer_access = m_ring.consumer_access();
+    if (consumer_access.length() > 0)
+    {
+      element = consumer_access.move_out();
+      return true;
+    }
+    if (m_spill_size.load(std::memory_order_acquire) > 0 && m_spill.pop(element))
+    {
+      m_spill_size.fetch_sub(1, std::memory_order_release);
+      return true;
+    }
+    return false;
+  }
+};
+
+// Submit functors to an AIThreadPool queue without ever waiting for room.
+//
+// The ring buffers of the thread pool are consumed by the pool itself, so here the
+// spill list is emptied from the functors: every functor that is moved into the pool
+// queue through this object, after it ran, moves spilled functors into the slot that
+// it freed. Both ends of the spill list are accessed with the producer lock of the
+// pool queue held.
+//
+// Usage:
+//
+//   threadpool::OverflowQueue overflow(thread_pool, queue_handle, capacity);
+//   overflow.submit([](){ ...; return false; });       // Never blocks, never drops.
+//
+// The OverflowQueue must outlive all functors that were submitted through it, and
+// all functors of the queue must be submitted through it: a functor that was added
+// directly doesn't move spilled functors into the queue when it is done.
+class OverflowQueue
+{
+ public:
+  using functor_type = std::function<bool()>;
+
+ private:
+  AIThreadPool& m_thread_pool;
+  AIQueueHandle const m_queue_handle;
+  int const m_capacity;
+  SpillList<functor_type> m_spill;
+  std::atomic<size_t> m_spill_size = ATOMIC_VAR_INIT(0);
+
+  functor_type wrap(functor_type&& functor)
+  {
+    return [this, functor = std::move(functor)]() mutable {
+      bool again = functor();
+      refill();
+      return again;
+    };
+  }
+
+  // Move spilled functors into the pool queue, while there is room.
+  void refill()
+  {
+    int moved = 0;
+    auto queues_access = m_thread_pool.queues_read_access();
+    auto& queue = m_thread_pool.get_queue(queues_access, m_queue_handle);
+    {
+      // The spill list must be tested with the producer lock held: submit() decides to spill
+      // and pushes under that lock, and if we tested before it pushed and returned, while
+      // the queue drains empty, the spilled functor would never be moved into the queue.
+      auto producer_access = queue.producer_access();
+      functor_type functor;
+      while (producer_access.length() < m_capacity && m_spill_size.load(std::memory_order_relaxed) > 0 && m_spill.pop(functor))
+      {
+        m_spill_size.fetch_sub(1, std::memory_order_relaxed);
+        producer_access.move_in(wrap(std::move(functor)));
+        ++moved;
+      }
+    }
+    for (int i = 0; i < moved; ++i)
+      queue.notify_one();
+  }
+
+ public:
+  OverflowQueue(AIThreadPool& thread_pool, AIQueueHandle queue_handle, int capacity) :
+    m_thread_pool(thread_pool), m_queue_handle(queue_handle), m_capacity(capacity) { }
+
+  // The number of functors that are waiting for room in the pool queue.
+  size_t spilled() const { return m_spill_size.load(std::memory_order_relaxed); }
+
+  void submit(functor_type functor)
+  {
+    auto queues_access = m_thread_pool.queues_read_access();
+    auto& queue = m_thread_pool.get_queue(queues_access, m_queue_handle);
+    {
+      auto producer_access = queue.producer_access();
+      if (m_spill_size.load(std::memory_order_relaxed) > 0 || producer_access.length() >= m_capacity)
+      {
+        // The queue is full (or was full and its spill list wasn't drained yet); the functors
+        // that are in the queue now will move this one in when they are done.
+        m_spill.push(std::move(functor));
+        m_spill_size.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      producer_access.move_in(wrap(std::move(functor)));
+    }
+    queue.notify_one();
+  }
+};
+
+} // namespace threadpool
@@ -0,0 +1,251 @@
+#pragma once
+
+#include "statefultask/DefaultMemoryPagePool.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include "debug.h"
+
+namespace statefultask {
+
+// Per-thread size class allocator for task objects.
+//
+// Creating a task (new MyTask, or statefultask::create<MyTask>()) goes through the
+// global operator new, which is one of the larger costs of fan-out workloads like
+// fibonacci.cxx. A class that also derives from TaskArenaAllocated gets a class
+// operator new/delete that allocate from a free list of the calling thread instead:
+//
+//   class MyTask : public AIStatefulTask, public statefultask::TaskArenaAllocated
+//
+// Every thread has a cache with one free list per size class (64, 128, ..., 2048 bytes,
+// header included; larger objects use the global operator new). Empty free lists are
+// refilled by cutting a block of AIMemoryPagePool::instance() into objects.
+//
+// Every object has a header that points to the cache of the thread that allocated it.
+// A task is usually released by another thread than the one that created it; such a
+// remote free is collected in a per-thread batch for that owner, and the whole batch is
+// pushed onto a lock-free stack of the owner with a single CAS when it is full, or when
+// an object of a different owner is freed. The owner takes its whole stack with one
+// exchange when its local free list is empty.
+//
+// Memory is never returned to the page pool; the cache of a thread that exits is
+// adopted by the next thread that starts allocating. Therefore the AIMemoryPagePool
+// must outlive all task objects (create it at the top of main, as usual).
+//
+// The remote frees of a thread are handed to their owner at the latest when the thread
+// exits, which writes to the freed objects. For the main thread that is after main()
+// returned, when the AIMemoryPagePool was already destroyed; therefore main() must call
+// TaskArena::flush_remote_frees() before the AIMemoryPagePool goes out of scope:
+//
+//   AIMemoryPagePool mpp;
+//   AIThreadPool thread_pool;
+//   ...                                                // Run the tasks and wait until they finished.
+//   statefultask::TaskArena::flush_remote_frees();
+class TaskArena
+{
+ public:
+  static constexpr int number_of_size_classes = 6;
+  static constexpr size_t min_size = 64;
+  static constexpr size_t max_size = min_size << (number_of_size_classes - 1);
+  static constexpr int max_remote_batch = 32;
+
+ private:
+  struct FreeNode
+  {
+    FreeNode* m_next;
+  };
+
+  struct ThreadCache;
+
+  struct alignas(16) Header
+  {
+    ThreadCache* m_owner;                               // nullptr when allocated with the global operator new.
+    int m_size_class;
+  };
+
+  struct ThreadCache
+  {
+    FreeNode* m_free[number_of_size_classes] = {};
+    alignas(64) std::atomic<FreeNode*> m_remote_free[number_of_size_classes] = {};
+    ThreadCache* m_next_orphan = nullptr;
+  };
+
+  // Remote frees of the current thread that weren't handed to their owner yet.
+  struct RemoteBatch
+  {
+    ThreadCache* m_owner = nullptr;
+    int m_size_class = 0;
+    FreeNode* m_first = nullptr;
+    FreeNode* m_last = nullptr;
+    int m_count = 0;
+  };
+
+  // Gives the thread cache back (with flush of the remote batch) when the thread exits.
+  struct ThreadState
+  {
+    ThreadCache* m_cache = nullptr;
+    RemoteBatch m_batch;
+    bool m_exited = false;                              // Set by the destructor; later allocations and frees (from other thread_local destructors) bypass the cache.
+    ~ThreadState();
+  };
+
+  static inline std::mutex s_orphans_mutex;
+  static inline ThreadCache* s_orphans = nullptr;
+  static thread_local ThreadState s_thread_state;
+
+  static int size_class(size_t size)
+  {
+    int size_class = 0;
+    while ((min_size << size_class) < size)
+      ++size_class;
+    return size_class;
+  }
+
+  static ThreadCache* thread_cache()
+  {
+    ThreadState& state = s_thread_state;
+    if (AI_UNLIKELY(!state.m_cache))
+    {
+      {
+        std::lock_guard<std::mutex> lock(s_orphans_mutex);
+        if (s_orphans)
+        {
+          state.m_cache = s_orphans;
+          s_orphans = s_orphans->m_next_orphan;
+        }
+      }
+      if (!state.m_cache)
+        state.m_cache = new ThreadCache;                // Never deleted: objects may still point to it.
+    }
+    return state.m_cache;
+  }
+
+  static void flush(RemoteBatch& batch)
+  {
+    if (batch.m_count == 0)
+      return;
+    std::atomic<FreeNode*>& stack = batch.m_owner->m_remote_free[batch.m_size_class];
+    FreeNode* head = stack.load(std::memory_order_relaxed);
+    do
+      batch.m_last->m_next = head;
+    while (!stack.compare_exchange_weak(head, batch.m_first, std::memory_order_release, std::memory_order_relaxed));
+    batch = RemoteBatch{};
+  }
+
+  // Cut a page pool block into objects of size_class and put them on the local free list.
+  static void refill(ThreadCache* cache, int size_class)
+  {
+    auto& page_pool = AIMemoryPagePool::instance();
+    size_t const object_size = min_size << size_class;
+    size_t const count = page_pool.block_size() / object_size;
+    ASSERT(count > 0);
+    char* block = static_cast<char*>(page_pool.allocate());
+    for (size_t i = 0; i < count; ++i)
+    {
+      FreeNode* node = reinterpret_cast<FreeNode*>(block + i * object_size);
+      node->m_next = cache->m_free[size_class];
+      cache->m_free[size_class] = node;
+    }
+  }
+
+ public:
+  static void* allocate(size_t size)
+  {
+    size += sizeof(Header);
+    Header* header;
+    if (AI_UNLIKELY(size > max_size || s_thread_state.m_exited))
+    {
+      // Too large, or the thread is exiting and already gave its cache back.
+      header = static_cast<Header*>(::operator new(size));
+      header->m_owner = nullptr;
+    }
+    else
+    {
+      int const sc = size_class(size);
+      ThreadCache* cache = thread_cache();
+      FreeNode* node = cache->m_free[sc];
+      if (AI_UNLIKELY(!node))
+      {
+        // Take everything that other threads gave back, or cut a new block.
+        node = cache->m_remote_free[sc].exchange(nullptr, std::memory_order_acquire);
+        if (!node)
+        {
+          refill(cache, sc);
+          node = cache->m_free[sc];
+        }
+      }
+      cache->m_free[sc] = node->m_next;
+      header = reinterpret_cast<Header*>(node);
+      header->m_owner = cache;
+      header->m_size_class = sc;
+    }
+    return header + 1;
+  }
+
+  static void deallocate(void* ptr)
+  {
+    if (!ptr)
+      return;
+    Header* header = static_cast<Header*>(ptr) - 1;
+    ThreadCache* owner = header->m_owner;
+    if (AI_UNLIKELY(!owner))
+    {
+      ::operator delete(header);
+      return;
+    }
+    int const sc = header->m_size_class;
+    FreeNode* node = reinterpret_cast<FreeNode*>(header);
+    ThreadState& state = s_thread_state;
+    if (owner == state.m_cache)
+    {
+      node->m_next = owner->m_free[sc];
+      owner->m_free[sc] = node;
+      return;
+    }
+    RemoteBatch& batch = state.m_batch;
+    if (batch.m_owner != owner || batch.m_size_class != sc)
+    {
+      flush(batch);
+      batch.m_owner = owner;
+      batch.m_size_class = sc;
+    }
+    node->m_next = batch.m_first;
+    batch.m_first = node;
+    if (!batch.m_last)
+      batch.m_last = node;
+    if (++batch.m_count == max_remote_batch || AI_UNLIKELY(state.m_exited))
+      flush(batch);
+  }
+
+  // Hand the remote frees of the calling thread to their owner now (they are also handed over when the thread exits).
+  // The main thread must call this after it freed its last task object and before the AIMemoryPagePool is destroyed.
+  static void flush_remote_frees() { flush(s_thread_state.m_batch); }
+};
+
+inline thread_local TaskArena::ThreadState TaskArena::s_thread_state;
+
+inline TaskArena::ThreadState::~ThreadState()
+{
+  // For the main thread this runs after the AIMemoryPagePool was destroyed; m_batch must be empty then (see flush_remote_frees).
+  flush(m_batch);
+  if (m_cache)
+  {
+    std::lock_guard<std::mutex> lock(s_orphans_mutex);
+    m_cache->m_next_orphan = s_orphans;
+    s_orphans = m_cache;
+    // The cache can now be adopted by another thread: frees after this point must take the remote path.
+    m_cache = nullptr;
+  }
+  m_exited = true;
+}
+
+// Derive a task class from this to allocate it with TaskArena.
+struct TaskArenaAllocated
+{
+  static void* operator new(size_t size) { return TaskArena::allocate(size); }
+  static void operator delete(void* ptr) { TaskArena::deallocate(ptr); }
+};
+
+} // namespace statefultask
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "debug.h"
+
+namespace threadpool {
+
+// A Chase-Lev work-stealing deque.
+//
+// The owner thread pushes and pops at the bottom (LIFO, which keeps the working set
+// in cache), any other thread may steal from the top (FIFO, which takes the oldest,
+// usually largest, piece of work). Only the owner may call push() and pop().
+//
+// T must be trivially copyable (normally a pointer): a stealing thread can read a
+// slot while the owner overwrites it, in which case the steal fails and the value
+// that was read is discarded.
+//
+// The memory orderings follow "Correct and Efficient Work-Stealing for Weak Memory
+// Models" (Lê, Pop, Cohen, Zappa Nardelli, PPoPP 2013). The buffer grows when full;
+// old buffers are kept until the deque is destroyed because a thief might still be
+// reading from them.
+template<typename T>
+class WorkStealingDeque
+{
+  static_assert(std::is_trivially_copyable_v<T>, "WorkStealingDeque<T> requires a trivially copyable T.");
+
+ private:
+  struct Buffer
+  {
+    int64_t const m_mask;
+    std::unique_ptr<std::atomic<T>[]> m_slots;
+
+    Buffer(int64_t capacity) : m_mask(capacity - 1), m_slots(new std::atomic<T>[capacity]) { }
+
+    int64_t capacity() const { return m_mask + 1; }
+    T get(int64_t index) const { return m_slots[index & m_mask].load(std::memory_order_relaxed); }
+    void put(int64_t index, T value) { m_slots[index & m_mask].store(value, std::memory_order_relaxed); }
+  };
+
+  alignas(64) std::atomic<int64_t> m_top;               // Stolen from (by any thread).
+  alignas(64) std::atomic<int64_t> m_bottom;            // Pushed to and popped from (by the owner).
+  std::atomic<Buffer*> m_buffer;
+  std::vector<std::unique_ptr<Buffer>> m_buffers;       // All buffers ever allocated (owner only).
+
+  Buffer* grow(Buffer* buffer, int64_t top, int64_t bottom)
+  {
+    auto new_buffer = std::make_unique<Buffer>(2 * buffer->capacity());
+    for (int64_t i = top; i < bottom; ++i)
+      new_buffer->put(i, buffer->get(i));
+    Buffer* result = new_buffer.get();
+    m_buffers.push_back(std::move(new_buffer));
+    m_buffer.store(result, std::memory_order_release);
+    return result;
+  }
+
+ public:
+  enum steal_result { success, empty, lost_race };
+
+  // initial_capacity must be a power of two.
+  WorkStealingDeque(int64_t initial_capacity = 256) : m_top(0), m_bottom(0)
+  {
+    ASSERT(initial_capacity > 0 && (initial_capacity & (initial_capacity - 1)) == 0);
+    m_buffers.push_back(std::make_unique<Buffer>(initial_capacity));
+    m_buffer.store(m_buffers.back().get(), std::memory_order_relaxed);
+  }
+
+  // Owner only.
+  void push(T value)
+  {
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+    int64_t top = m_top.load(std::memory_order_acquire);
+    Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+    if (bottom - top > buffer->m_mask)
+      buffer = grow(buffer, top, bottom);
+    buffer->put(bottom, value);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(bottom + 1, std::memory_order_relaxed);
+  }
+
+  // Owner only. Returns false if the deque is empty.
+  bool pop(T& value)
+  {
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+    Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+    m_bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = m_top.load(std::memory_order_relaxed);
+    if (top > bottom)
+    {
+      // Empty.
+      m_bottom.store(bottom + 1, std::memory_order_relaxed);
+      return false;
+    }
+    value = buffer->get(bottom);
+    if (top == bottom)
+    {
+      // The last element: race against thieves.
+      bool won = m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+      m_bottom.store(bottom + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  // Any thread.
+  steal_result steal(T& value)
+  {
+    int64_t top = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = m_bottom.load(std::memory_order_acquire);
+    if (top >= bottom)
+      return empty;
+    Buffer* buffer = m_buffer.load(std::memory_order_acquire);
+    value = buffer->get(top);
+    if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+      return lost_race;
+    return success;
+  }
+
+  // An estimate; exact only when called by the owner while nobody is stealing.
+  int64_t size() const
+  {
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+    int64_t top = m_top.load(std::memory_order_relaxed);
+    return bottom > top ? bottom - top : 0;
+  }
+};
+
+} // namespace threadpool
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "threadpool/AIThreadPool.h"
+#include "WorkStealingDeque.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "debug.h"
+
+namespace threadpool {
+
+// Work-stealing on top of the AIThreadPool priority queues.
+//
+// Every producer of an AIThreadPool queue takes the same producer_access() lock and
+// every consumer the same consumer lock; with many workers that submit (small) tasks
+// themselves, those two locks are the bottleneck. WorkStealingQueues adds, per
+// priority, a Chase-Lev deque for every worker thread:
+//
+// * A task that is submitted from a worker that is running a task of this object
+//   is pushed on that worker's own deque; no lock is taken.
+// * A worker runs the tasks of its own deque (newest first) and, when that is empty,
+//   steals the oldest task of another worker's deque of the same priority.
+// * Idle workers are woken up by putting a "drain" functor in the AIThreadPool queue
+//   of that priority, but only when a deque has more than one task and no drain
+//   functor is pending for it already.
+// * A task that is submitted from any other thread goes, wrapped, through the
+//   AIThreadPool queue as before.
+//
+// Because every priority uses its own AIThreadPool queue for the wake-ups, the
+// semantics of new_queue(capacity, reserved_threads) are preserved: the reserved
+// threads of a high priority queue are never used for the tasks of a lower priority.
+// A worker returns to the pool after running max_tasks_per_drain tasks, so that it
+// can pick up work of a higher priority.
+//
+// Usage:
+//
+//   AIThreadPool thread_pool(number_of_threads);
+//   AIQueueHandle high = thread_pool.new_queue(capacity, reserved_threads);
+//   AIQueueHandle low = thread_pool.new_queue(capacity);
+//   threadpool::WorkStealingQueues stealing(thread_pool, number_of_threads);
+//   int const high_priority = stealing.add_queue(high, capacity);      // Call add_queue in priority order, before submitting anything.
+//   int const low_priority = stealing.add_queue(low, capacity);
+//   stealing.submit(low_priority, [](){ ...; return false; });
+//
+// Tasks have the same signature as the AIThreadPool functors: bool(), where
+// returning true means "run me again".
+class WorkStealingQueues
+{
+ public:
+  using task_type = std::function<bool()>;
+  static constexpr int max_tasks_per_drain = 64;
+  static constexpr int steal_attempts = 4;              // Number of rounds over all other workers before giving up.
+
+ private:
+  struct alignas(64) PerWorker
+  {
+    WorkStealingDeque<task_type*> m_deque;
+    std::atomic_bool m_drain_pending = ATOMIC_VAR_INIT(false);
+  };
+
+  struct Priority
+  {
+    AIQueueHandle m_queue_handle;
+    int m_capacity;
+    std::vector<std::unique_ptr<PerWorker>> m_workers;
+  };
+
+  // The worker and priority of the task that the current thread is running (if any).
+  struct Context
+  {
+    WorkStealingQueues* m_owner = nullptr;
+    int m_worker = -1;
+    int m_priority = -1;
+  };
+  static inline thread_local Context s_context = { nullptr, -1, -1 };
+  static inline std::atomic<uint64_t> s_next_id = ATOMIC_VAR_INIT(0);
+
+  uint64_t const m_id;                                  // Unique per object; see worker_index().
+  AIThreadPool& m_thread_pool;
+  int const m_max_workers;
+  std::vector<Priority> m_priorities;
+  std::atomic_int m_next_worker_index = ATOMIC_VAR_INIT(0);
+  std::atomic_int m_posted = ATOMIC_VAR_INIT(0);        // The number of drain functors in (or running from) the AIThreadPool queues.
+
+  // Return the index of the current (pool) thread, assigning one the first time.
+  int worker_index()
+  {
+    // A thread can run the tasks of several WorkStealingQueues objects; remember its index per object.
+    // Objects are identified by m_id rather than by address, which can be reused by a later object.
+    static thread_local std::vector<std::pair<uint64_t, int>> s_indices;
+    for (auto const& entry : s_indices)
+      if (entry.first == m_id)
+        return entry.second;
+    int index = m_next_worker_index++;
+    // There can't be more threads running drain() than the number of threads in the pool.
+    ASSERT(index < m_max_workers);
+    s_indices.emplace_back(m_id, index);
+    return index;
+  }
+
+  // Put a functor in the AIThreadPool queue of priority that calls drain().
+  //
+  // If first_task is null then this is only a wake-up on behalf of worker announcer,
+  // which is dropped if the queue is full; then the m_drain_pending flag of announcer is
+  // reset and false is returned. Otherwise this blocks until there is room in the queue.
+  bool post(int priority, task_type* first_task, int announcer)
+  {
+    Priority const& p = m_priorities[priority];
+    auto queues_access = m_thread_pool.queues_read_access();
+    auto& queue = m_thread_pool.get_queue(queues_access, p.m_queue_handle);
+    for (;;)
+    {
+      {
+        auto queue_access = queue.producer_access();
+        if (queue_access.length() < p.m_capacity)
+        {
+          m_posted.fetch_add(1, std::memory_order_relaxed);
+          queue_access.move_in([this, priority, first_task, announcer](){
+              drain(priority, first_task, announcer);
+              // This must be the last access to this object: the destructor might be waiting for it.
+              m_posted.fetch_sub(1, std::memory_order_release);
+              return false;
+            });
+          break;
+        }
+      }
+      if (!first_task)
+      {
+        p.m_workers[announcer]->m_drain_pending.store(false, std::memory_order_relaxed);
+        return false;
+      }
+      std::this_thread::yield();
+    }
+    queue.notify_one();
+    return true;
+  }
+
+  // Make sure that the tasks left on the deque of worker will be run: returns false if that
+  // deque isn't empty, no drain is pending for it and the wake-up could not be posted.
+  bool announce(int priority, int worker)
+  {
+    PerWorker& w = *m_priorities[priority].m_workers[worker];
+    if (w.m_deque.size() == 0 || w.m_drain_pending.exchange(true, std::memory_order_relaxed))
+      return true;
+    return post(priority, nullptr, worker);
+  }
+
+  bool try_steal(int priority, int worker, task_type*& task)
+  {
+    auto& workers = m_priorities[priority].m_workers;
+    int const n = workers.size();
+    for (int attempt = 0; attempt < steal_attempts; ++attempt)
+    {
+      bool lost_race = false;
+      for (int i = 1; i < n; ++i)
+      {
+        auto result = workers[(worker + i) % n]->m_deque.steal(task);
+        if (result == WorkStealingDeque<task_type*>::success)
+          return true;
+        lost_race |= result == WorkStealingDeque<task_type*>::lost_race;
+      }
+      if (!lost_race)
+        break;                                          // Everything is empty.
+    }
+    return false;
+  }
+
+  void run(int priority, task_type* task)
+  {
+    if ((*task)())
+      push(priority, task);                             // Run it again later.
+    else
+      delete task;
+  }
+
+  // Called from a pool thread. Run first_task (if any), then tasks of our own deque, then stolen tasks.
+  void drain(int priority, task_type* first_task, int announcer)
+  {
+    int const worker = worker_index();
+    PerWorker& self = *m_priorities[priority].m_workers[worker];
+    Context saved_context = s_context;
+    s_context = { this, worker, priority };
+    if (announcer >= 0)
+      m_priorities[priority].m_workers[announcer]->m_drain_pending.store(false, std::memory_order_relaxed);
+
+    if (first_task)
+      run(priority, first_task);
+    task_type* task;
+    for (;;)
+    {
+      int count = 0;
+      while (count < max_tasks_per_drain && (self.m_deque.pop(task) || try_steal(priority, worker, task)))
+      {
+        run(priority, task);
+        ++count;
+      }
+      // Give other priorities a chance, but don't leave work behind unannounced: neither on
+      // our own deque, nor on that of the announcer, whose wake-up we consumed (we might have
+      // stopped at max_tasks_per_drain, or try_steal might have given up after lost races).
+      // If the queue is full, keep working instead.
+      if (announce(priority, worker) && (announcer < 0 || announcer == worker || announce(priority, announcer)))
+        break;
+    }
+    s_context = saved_context;
+  }
+
+  // Push task on the deque of the current worker; only call this from drain().
+  void push(int priority, task_type* task)
+  {
+    PerWorker& self = *m_priorities[priority].m_workers[s_context.m_worker];
+    self.m_deque.push(task);
+    // Wake up another worker to steal, if there is something to steal.
+    if (self.m_deque.size() > 1 && !self.m_drain_pending.exchange(true, std::memory_order_relaxed))
+      post(priority, nullptr, s_context.m_worker);
+  }
+
+ public:
+  // max_workers must be at least the number of threads of thread_pool.
+  WorkStealingQueues(AIThreadPool& thread_pool, int max_workers) :
+    m_id(s_next_id++), m_thread_pool(thread_pool), m_max_workers(max_workers) { }
+
+  // Wait until all drain functors that were put in the AIThreadPool queues ran; the
+  // thread pool must still be running. This includes wake-ups that are still pending
+  // after the last task finished.
+  ~WorkStealingQueues()
+  {
+    while (m_posted.load(std::memory_order_acquire) > 0)
+      std::this_thread::yield();
+    // All tasks must have been run.
+    for ([[maybe_unused]] auto& priority : m_priorities)
+      for ([[maybe_unused]] auto& worker : priority.m_workers)
+        ASSERT(worker->m_deque.size() == 0);
+  }
+
+  // Add the AIThreadPool queue for the next (lower) priority, that was created with capacity capacity.
+  // Returns the priority to pass to submit().
+  int add_queue(AIQueueHandle queue_handle, int capacity)
+  {
+    Priority priority{queue_handle, capacity, {}};
+    for (int worker = 0; worker < m_max_workers; ++worker)
+      priority.m_workers.push_back(std::make_unique<PerWorker>());
+    m_priorities.push_back(std::move(priority));
+    return m_priorities.size() - 1;
+  }
+
+  void submit(int priority, task_type task)
+  {
+    task_type* new_task = new task_type(std::move(task));
+    if (s_context.m_owner == this && s_context.m_priority == priority)
+      push(priority, new_task);
+    else
+      post(priority, new_task, -1);
+  }
+};
+
+} // namespace threadpool
@@ -0,0 +1,93 @@
+#include "sys.h"
+#include "utils/threading/SpinSemaphore.h"
+#include "ResultSink.h"
+#include "AdaptiveSpinSemaphore.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "debug.h"
+
+// Measure the wake up latency of a thread that waits on a semaphore, as function of
+// the time between two posts, for utils::SpinSemaphore (which goes to sleep on the
+// futex as soon as there is no token) and threadpool::AdaptiveSpinSemaphore.
+//
+// The latency is the time from just before post() until the waiting thread returned
+// from wait().
+
+namespace utils { using namespace threading; }
+
+using clock_type = std::chrono::steady_clock;
+
+int constexpr number_of_posts = 20000;
+
+static inline void cpu_relax()
+{
+  asm volatile ("pause" ::: "memory");
+}
+
+// Plain utils::SpinSemaphore, with the same wait() as the adaptive one but without spinning.
+struct PlainSemaphore : utils::SpinSemaphore
+{
+  void wait()
+  {
+    uint64_t word = fast_try_wait();
+    if ((word & tokens_mask) == 0)
+      slow_wait(word);
+  }
+};
+
+// Returns the average wake up latency in microseconds.
+template<typename SEMAPHORE>
+double measure(SEMAPHORE& semaphore, std::chrono::microseconds period)
+{
+  std::atomic<clock_type::rep> post_time;
+  std::atomic_bool consumed = true;
+  clock_type::rep latency_sum = 0;
+
+  std::thread consumer([&](){
+      for (int n = 0; n < number_of_posts; ++n)
+      {
+        semaphore.wait();
+        latency_sum += clock_type::now().time_since_epoch().count() - post_time.load(std::memory_order_acquire);
+        consumed.store(true, std::memory_order_release);
+      }
+    });
+
+  auto next = clock_type::now();
+  for (int n = 0; n < number_of_posts; ++n)
+  {
+    next += period;
+    // Busy wait until it is time for the next post (sleeping would add its own wake up latency).
+    while (clock_type::now() < next || !consumed.load(std::memory_order_acquire))
+      cpu_relax();
+    consumed.store(false, std::memory_order_relaxed);
+    post_time.store(clock_type::now().time_since_epoch().count(), std::memory_order_release);
+    semaphore.post(1);
+  }
+  consumer.join();
+
+  return std::chrono::duration<double, std::micro>(clock_type::duration(latency_sum)).count() / number_of_posts;
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  auto result_sink = benchmark::ResultSink::create();
+  result_sink->begin("Wake up latency", "time between posts (μs)", "latency (μs)");
+  for (int period_us : { 1, 2, 5, 10, 20, 50, 100 })
+  {
+    std::chrono::microseconds const period(period_us);
+    PlainSemaphore plain;
+    threadpool::AdaptiveSpinSemaphore adaptive;
+    double plain_us = measure(plain, period);
+    double adaptive_us = measure(adaptive, period);
+    std::cout << "Period " << period_us << " μs: SpinSemaphore: " << plain_us << " μs; AdaptiveSpinSemaphore: " << adaptive_us <<
+      " μs (spinning " << adaptive.spin_duration().count() << " ns, " << adaptive.fast_count() << " fast, " << adaptive.slow_count() << " slow)." << std::endl;
+    result_sink->data_point(period_us, plain_us, 0, "SpinSemaphore");
+    result_sink->data_point(period_us, adaptive_us, 0, "AdaptiveSpinSemaphore");
+  }
+  result_sink->end("linespoints");
+}
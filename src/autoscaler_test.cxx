@@ -0,0 +1,82 @@
+#include "sys.h"
+#include "threadpool/AIThreadPool.h"
+#include "utils/threading/Gate.h"
+#include "PoolAutoscaler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include "debug.h"
+
+// Run bursts of work through a thread pool that is resized by threadpool::PoolAutoscaler,
+// and print the number of threads during and after every burst.
+
+namespace utils { using namespace threading; }
+
+int constexpr capacity = 256;
+int constexpr number_of_bursts = 3;
+int constexpr tasks_per_burst = 20000;
+int constexpr reserved_threads = 1;
+
+static int volatile vv;
+
+void work()
+{
+  for (int i = 0; i < 20000; ++i)
+    vv = i;
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  int const max_threads = std::max(4U, std::thread::hardware_concurrency());
+  AIThreadPool thread_pool(2, max_threads);
+  [[maybe_unused]] AIQueueHandle high_priority_queue = thread_pool.new_queue(capacity, reserved_threads);
+  AIQueueHandle low_priority_queue = thread_pool.new_queue(capacity);
+
+  threadpool::PoolAutoscaler autoscaler(thread_pool, 2,
+      { .min_threads = 2, .max_threads = max_threads, .target_wait = std::chrono::microseconds(200), .hold_down = std::chrono::milliseconds(200) });
+  autoscaler.add_queue(high_priority_queue, capacity, reserved_threads);
+  autoscaler.add_queue(low_priority_queue, capacity);
+  autoscaler.start();
+
+  for (int burst = 0; burst < number_of_bursts; ++burst)
+  {
+    std::atomic_int remaining = tasks_per_burst;
+    utils::Gate finished;
+    int peak = autoscaler.number_of_threads();
+    for (int n = 0; n < tasks_per_burst;)
+    {
+      bool queued = false;
+      {
+        auto queues_access = thread_pool.queues_read_access();
+        auto& queue = thread_pool.get_queue(queues_access, low_priority_queue);
+        {
+          auto producer_access = queue.producer_access();
+          // Leave one slot for the probe of the autoscaler.
+          if (producer_access.length() < capacity - 1)
+          {
+            producer_access.move_in([&](){ work(); if (--remaining == 0) finished.open(); return false; });
+            queued = true;
+          }
+        }
+        if (queued)
+          queue.notify_one();
+      }
+      if (queued)
+        ++n;
+      else
+        std::this_thread::yield();
+      peak = std::max(peak, autoscaler.number_of_threads());
+    }
+    finished.wait();
+    std::cout << "Burst " << burst << ": peak number of threads: " << peak << std::flush;
+    // Idle: the pool shrinks back to the lower bound.
+    std::this_thread::sleep_for(std::chrono::milliseconds(200 * max_threads));
+    std::cout << "; after idling: " << autoscaler.number_of_threads() << " (lower bound " << autoscaler.lower_bound() << ")." << std::endl;
+  }
+
+  autoscaler.stop();
+}
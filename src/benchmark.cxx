@@ -8,16 +8,25 @@
 #include <sstream>
 #include <iomanip>
 #include <thread>
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include <memory>
 #include "cwds/benchmark.h"
 #include "cwds/gnuplot_tools.h"
 #include "utils/macros.h"
+#include "CpuFrequency.h"
+#include "HostCache.h"
+#include "ResultSink.h"
 
 using clock_type = std::chrono::high_resolution_clock;
 using time_point = clock_type::time_point;
 using Measurement = eda::FrequencyCounterResult;
 template<typename T> using MinAvgMax = eda::MinAvgMax<T>;
 template<typename T, int nk> using FrequencyCounter = eda::FrequencyCounter<T, nk>;
-using Plot = eda::Plot;
+
+// Where the plots and results are written to (see ResultSink::create).
+std::unique_ptr<benchmark::ResultSink> const result_sink = benchmark::ResultSink::create();
 
 namespace benchmark {
 
@@ -62,49 +71,28 @@ class Benchmark
   std::string now_offset_str(int precision) { std::ostringstream ss; ss << std::fixed << std::setprecision(precision) << m_now_offset; return ss.str(); }
   double cycles_per_ns() const { return m_cycles_per_ns; }
 
-  Benchmark(unsigned int cpu_nr, int hide_graphs = 0) : m_cpu_nr(cpu_nr), m_now_offset(0), m_delta(0)
+  // Use the calibration profile of this host and CPU, if any. Otherwise calibrate and write the profile.
+  // To force a full recalibration, remove the file benchmark::HostCache("benchmark_calibration.cpuN").path().
+  Benchmark(unsigned int cpu_nr, int hide_graphs = 0) : m_cpu_nr(cpu_nr), m_now_offset(0), m_delta(0), m_cycles_per_ns(0)
   {
     m_stopwatch1 = new Stopwatch(m_cpu_nr);
     m_stopwatch2 = new Stopwatch(m_cpu_nr);
+    if (load_profile() && !profile_drifted())
+      return;
     calibrate_now_offset(!(hide_graphs & hide_calibration_graph));
     calibrate_delta(!(hide_graphs & hide_delta_graphs));
     calibrate_cycles_per_ns();
     m_stopwatch1->calibrate_overhead(1000, 3);
+    store_profile();
   }
 
-  Benchmark(unsigned int cpu_nr, double now_offset = 0.0, int delta = 0, double cycles_per_ns = 0.0, int stopwatch_overhead = 0, int hide_graphs = 0) :
+  // Use explicitly passed calibration values.
+  Benchmark(unsigned int cpu_nr, double now_offset, int delta, double cycles_per_ns, int stopwatch_overhead) :
       m_cpu_nr(cpu_nr), m_now_offset(now_offset), m_delta(delta), m_cycles_per_ns(cycles_per_ns)
   {
     m_stopwatch1 = new Stopwatch(m_cpu_nr);
     m_stopwatch2 = new Stopwatch(m_cpu_nr);
-    bool calibrated = false;
-    if (now_offset == 0.0)
-    {
-      calibrate_now_offset(!(hide_graphs & hide_calibration_graph));
-      calibrated = true;
-    }
-    if (delta == 0)
-    {
-      calibrate_delta(!(hide_graphs & hide_delta_graphs));
-      calibrated = true;
-    }
-    if (cycles_per_ns == 0.0)
-    {
-      calibrate_cycles_per_ns();
-      calibrated = true;
-    }
-    if (stopwatch_overhead == 0)
-    {
-      m_stopwatch1->calibrate_overhead(1000, 3);
-      calibrated = true;
-    }
-    else
-      Stopwatch::s_stopwatch_overhead = stopwatch_overhead;
-    if (calibrated)
-    {
-      DoutFatal(dc::fatal, "Construct Benchmark with Benchmark(" << m_cpu_nr << ", " <<
-          m_now_offset << ", " << m_delta << ", " << m_cycles_per_ns << ", " << Stopwatch::s_stopwatch_overhead << ").");
-    }
+    Stopwatch::s_stopwatch_overhead = stopwatch_overhead;
   }
 
   ~Benchmark()
@@ -118,8 +106,149 @@ class Benchmark
   {
     return m_stopwatch1->measure(1000, functor);
   }
+
+ private:
+  HostCache profile() const { return HostCache("benchmark_calibration.cpu" + std::to_string(m_cpu_nr)); }
+  static HostCache::values_type profile_key();
+  bool load_profile();
+  void store_profile() const;
+  bool profile_drifted();
+  double measure_now_offset(int samples);
 };
 
+// The calibration values depend on the machine, the kernel (vDSO implementation of clock_gettime)
+// and whether or not this program was compiled with optimization.
+//static
+HostCache::values_type Benchmark::profile_key()
+{
+  return {
+    { "cpu_model", HostCache::cpu_model() },
+    { "kernel", HostCache::kernel_release() },
+#ifdef __OPTIMIZE__
+    { "optimized", "yes" }
+#else
+    { "optimized", "no" }
+#endif
+  };
+}
+
+bool Benchmark::load_profile()
+{
+  HostCache cache = profile();
+  auto values = cache.load();
+  if (values.empty())
+    return false;
+  for (auto const& key : profile_key())
+    if (values[key.first] != key.second)
+    {
+      Dout(dc::notice, cache.path() << " is stale (" << key.first << " changed to \"" << key.second << "\"); recalibrating.");
+      return false;
+    }
+  try
+  {
+    m_now_offset = std::stod(values.at("now_offset"));
+    m_delta = std::stoi(values.at("delta"));
+    m_cycles_per_ns = std::stod(values.at("cycles_per_ns"));
+    Stopwatch::s_stopwatch_overhead = std::stoi(values.at("stopwatch_overhead"));
+  }
+  catch (std::exception const&)
+  {
+    Dout(dc::warning, "Ignoring corrupt " << cache.path());
+    return false;
+  }
+  // measure_now_offset() and the benchmarks divide by and compare with these values.
+  if (!(m_now_offset > 0 && m_cycles_per_ns > 0 && std::isfinite(m_now_offset) && std::isfinite(m_cycles_per_ns)))
+  {
+    Dout(dc::warning, "Ignoring " << cache.path() << " with invalid values (now_offset = " << m_now_offset << ", cycles_per_ns = " << m_cycles_per_ns << ").");
+    return false;
+  }
+  Dout(dc::notice, "Loaded calibration profile " << cache.path() << ": Benchmark(" << m_cpu_nr << ", " <<
+      m_now_offset << ", " << m_delta << ", " << m_cycles_per_ns << ", " << Stopwatch::s_stopwatch_overhead << ").");
+  return true;
+}
+
+void Benchmark::store_profile() const
+{
+  auto values = profile_key();
+  std::ostringstream now_offset, cycles_per_ns;
+  now_offset << std::setprecision(9) << m_now_offset;
+  cycles_per_ns << std::setprecision(12) << m_cycles_per_ns;
+  values["now_offset"] = now_offset.str();
+  values["delta"] = std::to_string(m_delta);
+  values["cycles_per_ns"] = cycles_per_ns.str();
+  values["stopwatch_overhead"] = std::to_string(Stopwatch::s_stopwatch_overhead);
+  if (profile().store(values))
+    Dout(dc::notice, "Wrote calibration profile " << profile().path());
+}
+
+// Return the average number of nanoseconds between two calls to clock_type::now(), ignoring outliers.
+// This measures the same interval as calibrate_now_offset: with a Stopwatch stop() and start() between the two calls.
+double Benchmark::measure_now_offset(int samples)
+{
+  ASSERT(m_now_offset > 0);
+  double sum = 0;
+  int cnt = 0;
+  while (cnt < samples)
+  {
+    m_stopwatch1->prefetch();
+    m_stopwatch2->prefetch();
+    time_point start = clock_type::now();
+    time_point end = clock_type::now();
+
+    m_stopwatch1->start();
+    start = clock_type::now();
+    m_stopwatch1->stop();
+
+    m_stopwatch2->start();
+    end = clock_type::now();
+    m_stopwatch2->stop();
+
+    unsigned int nsi = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    if (nsi < 4 * m_now_offset)
+    {
+      sum += nsi;
+      ++cnt;
+    }
+  }
+  return sum / cnt;
+}
+
+// Do a few cheap measurements and compare them with the loaded profile.
+// Returns true if the profile can no longer be trusted.
+bool Benchmark::profile_drifted()
+{
+  bool drifted = false;
+
+  // The TSC frequency must match to within 0.2%.
+  double cycles_per_ns = CpuFrequency::measure(m_cpu_nr, std::chrono::milliseconds(50)) * 1e-9;
+  if (std::abs(cycles_per_ns - m_cycles_per_ns) > 0.002 * m_cycles_per_ns)
+  {
+    Dout(dc::notice, "Drift detected: cycles_per_ns is now " << cycles_per_ns << " (was " << m_cycles_per_ns << ").");
+    drifted = true;
+  }
+
+  // The overhead of clock_type::now() must match to within 10%.
+  double now_offset = measure_now_offset(100000);
+  if (std::abs(now_offset - m_now_offset) > 0.1 * m_now_offset)
+  {
+    Dout(dc::notice, "Drift detected: now_offset is now " << now_offset << " (was " << m_now_offset << ").");
+    drifted = true;
+  }
+
+  // The overhead of the Stopwatch itself must match to within 10% (but allow at least a couple of cycles difference).
+  int stopwatch_overhead = Stopwatch::s_stopwatch_overhead;
+  m_stopwatch1->calibrate_overhead(1000, 3);
+  if (std::abs((int)Stopwatch::s_stopwatch_overhead - stopwatch_overhead) > std::max(2, stopwatch_overhead / 10))
+  {
+    Dout(dc::notice, "Drift detected: stopwatch overhead is now " << Stopwatch::s_stopwatch_overhead << " (was " << stopwatch_overhead << ").");
+    drifted = true;
+  }
+  else
+    Stopwatch::s_stopwatch_overhead = stopwatch_overhead;
+
+  return drifted;
+}
+
 void Benchmark::calibrate_now_offset(bool show)
 {
   // Make an educated guess about the offset between two calls to clock_type::now().
@@ -172,17 +301,17 @@ void Benchmark::calibrate_now_offset(bool show)
     {
       std::ostringstream ss;
       ss << "Average overhead: " << std::fixed << std::setprecision(1) << m_now_offset << " ns.";
-      Plot plot("Calibration of overhead of calls to std::chrono::high\\_resolution\\_clock::now()",
-                "Overhead between two calls to now() (in ns)",
-                "Number of times measured (count)");
-      plot.add("set boxwidth 0.9");
-      plot.add("set style fill solid 0.5");
-      plot.add("set xtics 5 rotate");
-      plot.add("set mxtics 5");
-      plot.add("set tics out");
-      plot.add("unset key");
-      plot.add("set obj 4 rect at 44.5,9000000 size 10,1000000");
-      plot.add("set label 4 at 39.5,9000000 \"" + ss.str() + "\" left offset 1,.5");
+      result_sink->begin("Calibration of overhead of calls to std::chrono::high\\_resolution\\_clock::now()",
+                         "Overhead between two calls to now() (in ns)",
+                         "Number of times measured (count)");
+      result_sink->gnuplot_command("set boxwidth 0.9");
+      result_sink->gnuplot_command("set style fill solid 0.5");
+      result_sink->gnuplot_command("set xtics 5 rotate");
+      result_sink->gnuplot_command("set mxtics 5");
+      result_sink->gnuplot_command("set tics out");
+      result_sink->gnuplot_command("unset key");
+      result_sink->gnuplot_command("set obj 4 rect at 44.5,9000000 size 10,1000000");
+      result_sink->gnuplot_command("set label 4 at 39.5,9000000 \"" + ss.str() + "\" left offset 1,.5");
 
       unsigned int nsi_min = 100;
       unsigned int nsi_max = 0;
@@ -193,11 +322,12 @@ void Benchmark::calibrate_now_offset(bool show)
           nsi_min = std::min(nsi_min, nsi);
           nsi_max = std::max(nsi_max, nsi);
         }
-        plot.add_data_point(nsi, d[nsi], 0, "clock\\_type::now() x 2");
+        result_sink->data_point(nsi, d[nsi], 0, "clock\\_type::now() x 2");
       }
-      plot.set_xrange(nsi_min - 1, nsi_max + 1);
-      plot.set_header("smooth freq");
-      plot.show("boxes");
+      result_sink->gnuplot_command("set xrange [" + std::to_string(nsi_min - 1) + ":" + std::to_string(nsi_max + 1) + "]");
+      result_sink->gnuplot_header("smooth freq");
+      result_sink->value("now_offset", m_now_offset, "ns");
+      result_sink->end("boxes");
     }
   }
 }
@@ -271,7 +401,8 @@ void Benchmark::calibrate_delta(bool show)
     int width = high - low + 1;
     Dout(dc::notice, "Minimum values range " << mma);
 
-    Plot plot1("Histogram delta1", "delta1", "count");
+    // The points are only sent to the result sink once the calibration succeeded.
+    std::vector<std::array<double, 3>> points1;
     int best_delta1 = 0;
     {
       std::vector<int> count(mma_delta1.max() + 1 ,0);
@@ -283,7 +414,7 @@ void Benchmark::calibrate_delta(bool show)
           int bin = std::lround(d.min - low);
           if (bin == c && d.delta1 < 300)
           {
-            plot1.add_data_point(d.delta1, count[d.delta1]++, bin, "data");
+            points1.push_back({ (double)d.delta1, (double)count[d.delta1]++, (double)bin });
             if (count[d.delta1] > max_count)
             {
               max_count = count[d.delta1];
@@ -292,12 +423,6 @@ void Benchmark::calibrate_delta(bool show)
           }
         }
       }
-      plot1.add("set xtics 10");
-      plot1.add("set mxtics 10");
-      plot1.add("set tics out");
-      plot1.add("unset key");
-      plot1.add("set xrange [" + std::to_string(best_delta1 - 10) + ":" + std::to_string(best_delta1 + 10) + "]");
-
       if (max_count < 40000)
       {
         Dout(dc::notice, "Delta calibration failed, max_count delta1 = " << max_count << ". Retrying...");
@@ -306,7 +431,7 @@ void Benchmark::calibrate_delta(bool show)
       }
     }
 
-    Plot plot2("Histogram delta2", "delta2", "count");
+    std::vector<std::array<double, 3>> points2;
     int best_delta2 = 0;
     {
       std::vector<int> count(mma_delta2.max() + 1 ,0);
@@ -318,7 +443,7 @@ void Benchmark::calibrate_delta(bool show)
           int bin = std::lround(d.min - low);
           if (bin == c && d.delta2 < 300)
           {
-            plot2.add_data_point(d.delta2, count[d.delta2]++, bin, "data");
+            points2.push_back({ (double)d.delta2, (double)count[d.delta2]++, (double)bin });
             if (count[d.delta1] > max_count)
             {
               max_count = count[d.delta2];
@@ -327,12 +452,6 @@ void Benchmark::calibrate_delta(bool show)
           }
         }
       }
-      plot2.add("set xtics 10");
-      plot2.add("set mxtics 10");
-      plot2.add("set tics out");
-      plot2.add("unset key");
-      plot2.add("set xrange [" + std::to_string(best_delta2 - 10) + ":" + std::to_string(best_delta2 + 10) + "]");
-
       if (max_count < 30000 || best_delta2 != best_delta1)
       {
         if (max_count < 30000)
@@ -346,8 +465,21 @@ void Benchmark::calibrate_delta(bool show)
 
     if (show)
     {
-      plot1.show("points palette");
-      plot2.show("points palette");
+      int best_delta[2] = { best_delta1, best_delta2 };
+      std::vector<std::array<double, 3>> const* points[2] = { &points1, &points2 };
+      for (int n = 0; n < 2; ++n)
+      {
+        std::string delta_name = "delta" + std::to_string(n + 1);
+        result_sink->begin("Histogram " + delta_name, delta_name, "count");
+        result_sink->gnuplot_command("set xtics 10");
+        result_sink->gnuplot_command("set mxtics 10");
+        result_sink->gnuplot_command("set tics out");
+        result_sink->gnuplot_command("unset key");
+        result_sink->gnuplot_command("set xrange [" + std::to_string(best_delta[n] - 10) + ":" + std::to_string(best_delta[n] + 10) + "]");
+        for (auto const& point : *points[n])
+          result_sink->data_point(point[0], point[1], point[2], "data");
+        result_sink->end("points palette");
+      }
     }
 
     m_delta = best_delta1;
@@ -478,18 +610,16 @@ int main()
   using namespace benchmark;
 
   unsigned int cpu_nr = 0;
-  //Benchmark bm(cpu_nr, 0);
-  // All CPUs give the same numbers.
-  //Benchmark bm(cpu_nr, ?, ?, 3.61205905);         // Without optimization.
-  Benchmark bm(cpu_nr, 112, 217, 3.61205905, 87);   // This is with -O3.
+  // The first run on a given machine calibrates (which takes a few minutes); subsequent runs load the profile.
+  Benchmark bm(cpu_nr, hide_calibration_graph | hide_delta_graphs);
 
   std::thread t1(run1);
 
-  Plot plot("Clocks per load() in a loop.", "Loopsize", "Number of clocks");
+  result_sink->begin("Clocks per load() in a loop.", "Loopsize", "Number of clocks");
   for (int rm = 1; rm < 100; ++rm)
   {
     auto measurement = bm.measure([rm](){ for (int r = 0; r < rm; ++r) { bv = s_atomic.fetch_add(1); } });
-    plot.add_data_point(rm, measurement.m_cycles, 0, measurement.is_t999() ? "99.9%" : measurement.is_tm1() ? "m1" : "m2");
+    result_sink->data_point(rm, measurement.m_cycles, 0, measurement.is_t999() ? "99.9%" : measurement.is_tm1() ? "m1" : "m2");
     double ns = measurement.m_cycles / bm.cycles_per_ns();
     std::cout << "rm = " << rm << ", c1 = " << measurement.m_cycles << " cycles (" << ns << " ns)." << std::endl;
   }
@@ -497,14 +627,14 @@ int main()
   Dout(dc::notice, "s_atomic = " << s_atomic);
   t1.join();
 
-  //plot.set_header("smooth freq");
-  //plot.show("boxes");
-  //plot.add("set xtics 5");
-  //plot.add("set mxtics 5");
-  plot.add("set tics out");
-  plot.set_header("using 1:2");
-  //plot.add("unset key");
-  plot.show("points");
+  //result_sink->gnuplot_header("smooth freq");
+  //result_sink->end("boxes");
+  //result_sink->gnuplot_command("set xtics 5");
+  //result_sink->gnuplot_command("set mxtics 5");
+  result_sink->gnuplot_command("set tics out");
+  result_sink->gnuplot_header("using 1:2");
+  //result_sink->gnuplot_command("unset key");
+  result_sink->end("points");
 }
 
 int bv;
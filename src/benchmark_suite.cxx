@@ -0,0 +1,507 @@
+#include "sys.h"
+#include "debug.h"
+#include "cwds/benchmark.h"
+#include "statefultask/AIStatefulTask.h"
+#include "statefultask/AIStatefulTaskMutex.h"
+#include "statefultask/DefaultMemoryPagePool.h"
+#include "threadpool/AIThreadPool.h"
+#include "threadpool/Timer.h"
+#include "threadsafe/PointerStorage.h"
+#include "utils/threading/Gate.h"
+#include "utils/threading/SpinSemaphore.h"
+#include "CpuFrequency.h"
+#include "ResultSink.h"
+#include "TaskArena.h"
+#include "RunAll.h"
+#include <boost/interprocess/sync/file_lock.hpp>
+#include <farmhash.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Run a fixed set of micro benchmarks and compare the results with a baseline.
+//
+// Usage: benchmark_suite [--list] [--filter <substring>] [--cpu <nr>] [--baseline <file>] [--update-baseline]
+//
+// Each case is repeated until the eda::FrequencyCounter of its results converged (or the
+// maximum number of runs was reached). The result, in nanoseconds per iteration, is then
+// compared with the baseline file; when it is more than the tolerance (in percent) slower
+// the case is reported as a regression and the program exits with status 1.
+//
+// The baseline file contains one line per case: <name> <ns per iteration> <tolerance in percent>.
+// The tolerance in the file overrides the default tolerance of the case.
+//
+// Set BENCHMARK_OUTPUT_FILE when using BENCHMARK_OUTPUT=json or csv, to keep the records
+// separated from the summary that is printed to std::cout.
+
+namespace utils { using namespace threading; }
+
+namespace {
+
+int constexpr max_runs = 1000;
+int constexpr minimum_of = 3;
+// The width of a FrequencyCounter bucket, relative to the result of the warm-up run.
+double constexpr bucket_resolution = 0.01;
+
+inline void cpu_relax()
+{
+  asm volatile ("pause");
+}
+
+// A measurement function runs iterations of the code under test and returns the number of clock cycles used.
+using measure_type = std::function<uint64_t(benchmark::Stopwatch& stopwatch, size_t iterations)>;
+
+struct Case
+{
+  std::string m_name;
+  size_t m_iterations;          // The number of iterations per measurement.
+  double m_tolerance;           // Default allowed slowdown, in percent.
+  measure_type m_measure;
+};
+
+std::vector<Case>& cases()
+{
+  static std::vector<Case> s_cases;
+  return s_cases;
+}
+
+struct Register
+{
+  Register(std::string name, size_t iterations, double tolerance, measure_type measure)
+  {
+    cases().push_back({std::move(name), iterations, tolerance, std::move(measure)});
+  }
+};
+
+// Measure a loop that runs entirely in the (pinned) thread of the stopwatch.
+template<typename BODY>
+uint64_t measure_loop(benchmark::Stopwatch& stopwatch, size_t iterations, BODY body)
+{
+  stopwatch.start();
+  for (size_t i = 0; i < iterations; ++i)
+    body(i);
+  stopwatch.stop();
+  return stopwatch.diff_cycles() - stopwatch.s_stopwatch_overhead;
+}
+
+//-----------------------------------------------------------------------------
+// The cases.
+
+Register mutex_uncontended("mutex_uncontended", 100000, 10.0,
+    [](benchmark::Stopwatch& stopwatch, size_t iterations) {
+      static std::mutex m;
+      return measure_loop(stopwatch, iterations, [](size_t){ m.lock(); m.unlock(); });
+    });
+
+// See mutex_benchmark.cxx.
+Register mutex_contended("mutex_contended_4threads", 40000, 25.0,
+    [](benchmark::Stopwatch& stopwatch, size_t iterations) {
+      int constexpr number_of_threads = 4;
+      int constexpr skip_cores = 2;
+      static std::mutex m;
+      std::atomic_int ready = ATOMIC_VAR_INIT(0);
+      std::atomic_bool go = ATOMIC_VAR_INIT(false);
+      std::vector<std::thread> threads;
+      for (int t = 1; t < number_of_threads; ++t)
+        threads.emplace_back([&, t](){
+          benchmark::Stopwatch pin((t * skip_cores) % std::thread::hardware_concurrency());
+          ++ready;
+          while (!go.load(std::memory_order_acquire))
+            cpu_relax();
+          volatile int v __attribute__ ((unused));
+          for (size_t i = 0; i < iterations / number_of_threads; ++i)
+          {
+            m.lock();
+            for (int j = 0; j < 50; ++j)
+              v = j;
+            m.unlock();
+          }
+        });
+      while (ready < number_of_threads - 1)
+        cpu_relax();
+      go.store(true, std::memory_order_release);
+      volatile int v __attribute__ ((unused));
+      uint64_t cycles = measure_loop(stopwatch, iterations / number_of_threads, [&](size_t){
+          m.lock();
+          for (int j = 0; j < 50; ++j)
+            v = j;
+          m.unlock();
+        });
+      for (auto& thread : threads)
+        thread.join();
+      return cycles;
+    });
+
+// See hash_test.cxx.
+Register farmhash("farmhash_Hash64WithSeeds", 100000, 10.0,
+    [](benchmark::Stopwatch& stopwatch, size_t iterations) {
+      std::string const s("texture123.secondlife.com");
+      static volatile uint64_t hash;
+      return measure_loop(stopwatch, iterations, [&s](size_t i){ hash = util::Hash64WithSeeds(s.data(), s.length(), 0x9ae16a3b2f90404fULL, i); });
+    });
+
+// See pointer_storage_test.cxx.
+Register pointer_storage("PointerStorage_insert_erase", 10000, 15.0,
+    [](benchmark::Stopwatch& stopwatch, size_t iterations) {
+      static threadsafe::PointerStorage<int> ps(2000);
+      static int value;
+      return measure_loop(stopwatch, iterations, [](size_t){ ps.erase(ps.insert(&value)); });
+    });
+
+// See spin_wakeup_test.cxx.
+Register spin_semaphore("SpinSemaphore_post_try_wait", 100000, 10.0,
+    [](benchmark::Stopwatch& stopwatch, size_t iterations) {
+      static utils::SpinSemaphore sem;
+      return measure_loop(stopwatch, iterations, [](size_t){
+          sem.post(1);
+          [[maybe_unused]] uint64_t word = sem.fast_try_wait();
+          ASSERT((word & utils::SpinSemaphore::tokens_mask) != 0);
+        });
+    });
+
+// See cv_wait.cxx: a ping-pong between two threads using a condition variable.
+Register cv_ping_pong("condition_variable_round_trip", 2000, 25.0,
+    [](benchmark::Stopwatch& stopwatch, size_t iterations) {
+      int constexpr skip_cores = 2;
+      std::mutex m;
+      std::condition_variable cv;
+      size_t turn = 0;
+      std::thread other([&](){
+        // Otherwise this thread inherits the affinity of the measuring thread and both run on the same core.
+        benchmark::Stopwatch pin(skip_cores % std::thread::hardware_concurrency());
+        for (size_t i = 0; i < iterations; ++i)
+        {
+          std::unique_lock<std::mutex> lk(m);
+          cv.wait(lk, [&](){ return turn % 2 == 1; });
+          ++turn;
+          cv.notify_one();
+        }
+      });
+      uint64_t cycles = measure_loop(stopwatch, iterations, [&](size_t){
+          std::unique_lock<std::mutex> lk(m);
+          ++turn;
+          cv.notify_one();
+          cv.wait(lk, [&](){ return turn % 2 == 0; });
+        });
+      other.join();
+      return cycles;
+    });
+
+// See filelock.cxx.
+Register file_lock("file_lock_unlock_lock", 10000, 15.0,
+    [](benchmark::Stopwatch& stopwatch, size_t iterations) {
+      char const* const lock_file_name = "benchmark_suite.lock";
+      std::ofstream(lock_file_name).close();
+      boost::interprocess::file_lock flock(lock_file_name);
+      flock.lock();
+      uint64_t cycles = measure_loop(stopwatch, iterations, [&](size_t){ flock.unlock(); flock.lock(); });
+      flock.unlock();
+      return cycles;
+    });
+
+// See threadpool.cxx: the cost of moving a functor into an AIThreadPool queue and executing it.
+AIQueueHandle s_queue_handle;
+int constexpr queue_capacity = 1024;
+
+Register threadpool_round_trip("AIThreadPool_move_in_execute", 1000, 25.0,
+    [](benchmark::Stopwatch& stopwatch, size_t iterations) {
+      utils::Gate finished;
+      std::atomic<size_t> executed = ATOMIC_VAR_INIT(0);
+      auto queues_access = AIThreadPool::instance().queues_read_access();
+      auto& queue = AIThreadPool::instance().get_queue(queues_access, s_queue_handle);
+      stopwatch.start();
+      for (size_t i = 0; i < iterations; ++i)
+      {
+        for (;;)
+        {
+          auto access = queue.producer_access();
+          if (access.length() < queue_capacity)
+          {
+            access.move_in([&, iterations](){ if (++executed == iterations) finished.open(); return false; });
+            break;
+          }
+        }
+        queue.notify_one();
+      }
+      finished.wait();
+      stopwatch.stop();
+      return stopwatch.diff_cycles() - stopwatch.s_stopwatch_overhead;
+    });
+
+// See timer_test.cxx: starting and stopping a threadpool::Timer, before it expires.
+Register timer_start_stop("Timer_start_stop", 100000, 15.0,
+    [](benchmark::Stopwatch& stopwatch, size_t iterations) {
+      threadpool::Timer timer;
+      threadpool::Timer::Interval const interval = threadpool::Interval<10, std::chrono::seconds>();
+      threadpool::Timer::time_point const now = threadpool::Timer::clock_type::now();
+      return measure_loop(stopwatch, iterations, [&](size_t){ timer.start(interval, [](){ }, now); timer.stop(); });
+    });
+
+// See AIStatefulTaskMutex_test.cxx: run a task that locks and unlocks an AIStatefulTaskMutex (uncontended).
+AIStatefulTaskMutex s_task_mutex;
+
+class LockTask : public AIStatefulTask, public statefultask::TaskArenaAllocated
+{
+ protected:
+  using direct_base_type = AIStatefulTask;
+
+  enum lock_task_state_type {
+    LockTask_lock = direct_base_type::state_end,
+    LockTask_done
+  };
+
+ public:
+  static state_type constexpr state_end = LockTask_done + 1;
+
+  LockTask() CWDEBUG_ONLY(: AIStatefulTask(false)) { }
+
+ protected:
+  ~LockTask() override { }
+  char const* task_name_impl() const override { return "LockTask"; }
+
+  char const* state_str_impl(state_type run_state) const override
+  {
+    switch (run_state)
+    {
+      AI_CASE_RETURN(LockTask_lock);
+      AI_CASE_RETURN(LockTask_done);
+    }
+    ASSERT(false);
+    return "UNKNOWN STATE";
+  }
+
+  void multiplex_impl(state_type run_state) override
+  {
+    switch (run_state)
+    {
+      case LockTask_lock:
+        set_state(LockTask_done);
+        if (!s_task_mutex.lock(this, 1))
+        {
+          wait(1);
+          break;
+        }
+        [[fallthrough]];
+      case LockTask_done:
+        s_task_mutex.unlock();
+        finish();
+        break;
+    }
+  }
+};
+
+Register task_mutex("AIStatefulTaskMutex_run_lock_unlock", 10000, 15.0,
+    [](benchmark::Stopwatch& stopwatch, size_t iterations) {
+      return measure_loop(stopwatch, iterations, [](size_t){
+          boost::intrusive_ptr<LockTask> task = new LockTask;
+          task->run(AIStatefulTask::Handler::immediate);        // Finishes before run() returns: the mutex is never contended.
+        });
+    });
+
+// See RunAll.h: start a batch of LockTask's through the thread pool queue and wait until
+// all of them finished; once with a run(handler, callback) per task from this thread
+// and once with statefultask::run_all. Both report the time per task.
+int constexpr run_batch_size = 256;                     // Less than queue_capacity.
+
+std::vector<boost::intrusive_ptr<AIStatefulTask>> create_lock_tasks(size_t n)
+{
+  std::vector<boost::intrusive_ptr<AIStatefulTask>> tasks;
+  for (size_t i = 0; i < n; ++i)
+    tasks.emplace_back(new LockTask);
+  return tasks;
+}
+
+Register run_loop("AIStatefulTask_run_loop", run_batch_size, 25.0,
+    [](benchmark::Stopwatch& stopwatch, size_t iterations) {
+      auto tasks = create_lock_tasks(iterations);
+      utils::Gate finished;
+      std::atomic<size_t> remaining = ATOMIC_VAR_INIT(iterations);
+      stopwatch.start();
+      for (auto& task : tasks)
+        task->run(s_queue_handle, [&](bool){ if (--remaining == 0) finished.open(); });
+      finished.wait();
+      stopwatch.stop();
+      return stopwatch.diff_cycles() - stopwatch.s_stopwatch_overhead;
+    });
+
+Register run_all_batch("statefultask_run_all", run_batch_size, 25.0,
+    [](benchmark::Stopwatch& stopwatch, size_t iterations) {
+      auto tasks = create_lock_tasks(iterations);
+      utils::Gate finished;
+      stopwatch.start();
+      statefultask::run_all(tasks, s_queue_handle, [&](bool){ finished.open(); });
+      finished.wait();
+      stopwatch.stop();
+      return stopwatch.diff_cycles() - stopwatch.s_stopwatch_overhead;
+    });
+
+//-----------------------------------------------------------------------------
+
+struct Baseline
+{
+  double m_ns;
+  double m_tolerance;
+};
+
+std::map<std::string, Baseline> read_baseline(std::string const& filename)
+{
+  std::map<std::string, Baseline> baseline;
+  std::ifstream file(filename);
+  std::string line;
+  while (std::getline(file, line))
+  {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream ss(line);
+    std::string name;
+    Baseline entry;
+    if (ss >> name >> entry.m_ns >> entry.m_tolerance)
+      baseline[name] = entry;
+  }
+  return baseline;
+}
+
+// Returns the number of nanoseconds per iteration.
+double run_case(Case const& test_case, int cpu)
+{
+  benchmark::Stopwatch stopwatch(cpu);
+
+  // Warm up and determine the bucket width.
+  double warm_up_cycles = test_case.m_measure(stopwatch, test_case.m_iterations);
+  double bucket_width = std::max(1.0, warm_up_cycles * bucket_resolution);
+
+  eda::FrequencyCounter<uint64_t, 8> fc;
+  bool converged = false;
+  for (int run = 0; run < max_runs && !converged; ++run)
+  {
+    // Only use the fastest of minimum_of measurements.
+    uint64_t cycles = std::numeric_limits<uint64_t>::max();
+    for (int m = 0; m < minimum_of; ++m)
+      cycles = std::min(cycles, test_case.m_measure(stopwatch, test_case.m_iterations));
+    converged = fc.add(std::llround(cycles / bucket_width));
+  }
+  double buckets = converged ? fc.result().m_cycles : fc.average();
+  if (!converged)
+    Dout(dc::warning, test_case.m_name << " did not converge after " << max_runs << " runs; using the average.");
+  return benchmark::CpuFrequency::nanoseconds(buckets * bucket_width) / test_case.m_iterations;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  int cpu = 0;
+  std::string filter;
+  std::string baseline_filename = "benchmark_suite.baseline";
+  bool update_baseline = false;
+  bool list = false;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--list")
+      list = true;
+    else if (arg == "--update-baseline")
+      update_baseline = true;
+    else if (arg == "--filter" && i + 1 < argc)
+      filter = argv[++i];
+    else if (arg == "--cpu" && i + 1 < argc)
+      cpu = std::stoi(argv[++i]);
+    else if (arg == "--baseline" && i + 1 < argc)
+      baseline_filename = argv[++i];
+    else
+    {
+      std::cerr << "Usage: " << argv[0] << " [--list] [--filter <substring>] [--cpu <nr>] [--baseline <file>] [--update-baseline]" << std::endl;
+      return 2;
+    }
+  }
+
+  if (list)
+  {
+    for (auto const& test_case : cases())
+      std::cout << test_case.m_name << " (" << test_case.m_iterations << " iterations, tolerance " << test_case.m_tolerance << "%)" << std::endl;
+    return 0;
+  }
+
+  // Calibrate in a helper thread: a Stopwatch pins the thread that creates it, and the
+  // threads of the pool would inherit that affinity.
+  std::thread calibration([cpu](){
+      benchmark::Stopwatch stopwatch(cpu);
+      stopwatch.calibrate_overhead(1000, 3);
+      benchmark::CpuFrequency::cycles_per_second();
+    });
+  calibration.join();
+
+  AIMemoryPagePool mpp;                 // Create before thread_pool.
+  AIThreadPool thread_pool;
+  s_queue_handle = thread_pool.new_queue(queue_capacity);
+
+  auto result_sink = benchmark::ResultSink::create();
+  auto baseline = read_baseline(baseline_filename);
+  std::map<std::string, Baseline> new_baseline = baseline;
+  int regressions = 0;
+
+  result_sink->begin("benchmark_suite", "case", "ns per iteration");
+  for (auto const& test_case : cases())
+  {
+    if (test_case.m_name.find(filter) == std::string::npos)
+      continue;
+
+    double ns = run_case(test_case, cpu);
+    result_sink->value(test_case.m_name, ns, "ns");
+
+    std::cout << std::left << std::setw(40) << test_case.m_name << std::right << std::fixed << std::setprecision(2) << std::setw(12) << ns << " ns";
+    auto entry = baseline.find(test_case.m_name);
+    if (entry == baseline.end())
+      std::cout << "   (no baseline)";
+    else
+    {
+      double change = 100.0 * (ns - entry->second.m_ns) / entry->second.m_ns;
+      std::cout << std::showpos << std::setw(10) << change << '%' << std::noshowpos;
+      if (change > entry->second.m_tolerance)
+      {
+        std::cout << "   REGRESSION (tolerance " << entry->second.m_tolerance << "%)";
+        ++regressions;
+      }
+    }
+    std::cout << std::endl;
+
+    double tolerance = entry == baseline.end() ? test_case.m_tolerance : entry->second.m_tolerance;
+    new_baseline[test_case.m_name] = Baseline{ns, tolerance};
+  }
+  result_sink->end("boxes");
+
+  // Before mpp is destroyed.
+  statefultask::TaskArena::flush_remote_frees();
+
+  if (update_baseline)
+  {
+    std::ofstream file(baseline_filename);
+    file << "# <name> <ns per iteration> <tolerance in percent>\n";
+    for (auto const& entry : new_baseline)
+      file << entry.first << ' ' << entry.second.m_ns << ' ' << entry.second.m_tolerance << '\n';
+    std::cout << "Wrote " << baseline_filename << std::endl;
+    return 0;
+  }
+
+  if (regressions > 0)
+  {
+    std::cout << regressions << " regression(s) detected." << std::endl;
+    return 1;
+  }
+}
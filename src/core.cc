@@ -6,8 +6,11 @@
 #include <iostream>
 #include <thread>
 #include <cassert>
+#include <map>
+#include <memory>
 #include "cwds/benchmark.h"
 #include "cwds/gnuplot_tools.h"
+#include "ResultSink.h"
 
 int constexpr bufsize = 16;
 int const cpu_nr[2] = { 0, 2 };
@@ -16,6 +19,10 @@ std::atomic<uint16_t> s_atomic = ATOMIC_VAR_INIT(uint16_t{0});
 std::array<std::array<std::atomic<uint64_t>, bufsize>, 2> m_ringbuffers;
 std::array<std::array<int64_t, bufsize>, 2> m_diff;
 
+// Set BENCHMARK_OUTPUT=json or csv to get machine readable output (see ResultSink::create).
+std::unique_ptr<benchmark::ResultSink> const result_sink = benchmark::ResultSink::create();
+using histogram_type = std::map<int64_t, uint64_t>;
+
 void init()
 {
   s_atomic.store(10U);
@@ -28,7 +35,7 @@ void init()
 
 #define barrier() asm volatile("": : :"memory")
 
-void f(int cpu, eda::FrequencyCounter<int64_t>& fc)
+void f(int cpu, eda::FrequencyCounter<int64_t>& fc, histogram_type& histogram)
 {
   benchmark::Stopwatch stopwatch(cpu_nr[cpu]);  // Pin this thread to one core.
   stopwatch.start();
@@ -102,7 +109,10 @@ void f(int cpu, eda::FrequencyCounter<int64_t>& fc)
         if (diff > -300)
         {
           if (delta_2_1 == 34 && -50 <= diff && diff <= 50)
+          {
             fc.add(diff);
+            ++histogram[diff];
+          }
           if (diff < my_diff_buffer[other_index])
           {
             my_diff_buffer[other_index] = diff;
@@ -115,9 +125,9 @@ void f(int cpu, eda::FrequencyCounter<int64_t>& fc)
   }
   stopwatch.stop();
   std::cout << "CPU " << cpu_nr[cpu] << " ran for " << stopwatch.diff_cycles() << " cycles." << std::endl;
-  std::cout << "The min/avg/max value of delta_3_1 is " << delta_3_1_mam << std::endl;
+  result_sink->min_avg_max("CPU " + std::to_string(cpu_nr[cpu]) + " delta_3_1", delta_3_1_mam);
   assert(std::abs(delta_3_1_mam.min() - delta_3_1_min) <= delta_3_1_mam.min() / 4);     // Time to update delta_3_1_min.
-  std::cout << "The min/avg/max value of delta_2_1 is " << delta_2_1_mam << std::endl;
+  result_sink->min_avg_max("CPU " + std::to_string(cpu_nr[cpu]) + " delta_2_1", delta_2_1_mam);
 }
 
 int main()
@@ -126,22 +136,26 @@ int main()
     for (int i = 0; i < bufsize; ++i)
       std::atomic_init(&a[i], 0);
   std::array<eda::FrequencyCounter<int64_t>, 2> fcs;
+  std::array<histogram_type, 2> histograms;
   for (int i = 0; i < 100; ++i)
   {
     std::cout << "i = " << i << std::endl;
     init();
-    std::thread t0([&fcs](){ f(0, fcs[0]); });
-    std::thread t1([&fcs](){ f(1, fcs[1]); });
+    std::thread t0([&](){ f(0, fcs[0], histograms[0]); });
+    std::thread t1([&](){ f(1, fcs[1], histograms[1]); });
     t0.join();
     t1.join();
   }
   int64_t min[2] = { std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::max() };
   for (int cpu = 0; cpu <= 1; ++cpu)
   {
-    eda::PlotHistogram plot1("Histogram of TSC difference when CPU #" + std::to_string(cpu_nr[cpu]) + " incremented s\\_atomic last.",
+    result_sink->begin("Histogram of TSC difference when CPU #" + std::to_string(cpu_nr[cpu]) + " incremented s\\_atomic last.",
         "diff (clocks), peak: " + std::to_string(fcs[cpu].most()), "Frequency (count)");
-    //plot1.set_yrange(0, 350000);
-    plot1.show(fcs[cpu]);
+    //result_sink->gnuplot_command("set yrange [0:350000]");
+    for (auto const& bin : histograms[cpu])
+      result_sink->histogram_bin(bin.first, bin.second, "CPU #" + std::to_string(cpu_nr[cpu]));
+    result_sink->value("peak", fcs[cpu].most(), "clocks");
+    result_sink->end("boxes");
     eda::FrequencyCounter<int64_t> frequency_counter;
     std::cout << "CPU " << cpu_nr[cpu] << ":";
     for (int64_t e : m_diff[cpu])
@@ -0,0 +1,123 @@
+#include "sys.h"
+#include "statefultask/DefaultMemoryPagePool.h"
+#include "threadpool/AIThreadPool.h"
+#include "utils/threading/Gate.h"
+#include "CoroutineTask.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include "debug.h"
+
+// Tasks written with statefultask::CoroutineTask.
+//
+// CoFibonacci is fibonacci.cxx as a coroutine: it runs the largest child through the
+// thread pool and the smallest one immediately, and then waits until both finished.
+// Sequence exercises the other awaitables: a timer, yielding to another queue and
+// waiting for a condition that is signalled from the main thread.
+
+namespace utils { using namespace threading; }
+
+AIQueueHandle s_high_priority_queue;
+AIQueueHandle s_low_priority_queue;
+
+class CoFibonacci : public statefultask::CoroutineTask
+{
+ private:
+  int m_index;
+  int m_value;
+
+ public:
+  CoFibonacci(int index) : CWDEBUG_ONLY(CoroutineTask(false),) m_index(index), m_value(0) { }
+
+  int value() const { return m_value; }
+
+ protected:
+  ~CoFibonacci() override { }
+  char const* task_name_impl() const override { return "CoFibonacci"; }
+  Body body() override;
+};
+
+statefultask::CoroutineTask::Body CoFibonacci::body()
+{
+  if (m_index < 2)
+  {
+    m_value = 1;
+    co_return;
+  }
+  boost::intrusive_ptr<CoFibonacci> largest = new CoFibonacci(m_index - 1);
+  boost::intrusive_ptr<CoFibonacci> smallest = new CoFibonacci(m_index - 2);
+  largest->run(s_high_priority_queue, this, 1);
+  co_await run_child(smallest, Handler::immediate);
+  co_await wait_until(1, [&](){ return largest->finished(); });
+  m_value = largest->value() + smallest->value();
+}
+
+class Sequence : public statefultask::CoroutineTask
+{
+ private:
+  std::atomic<bool> m_bumped;
+
+ public:
+  std::atomic<int> m_steps;
+
+  Sequence() : CWDEBUG_ONLY(CoroutineTask(true),) m_bumped(false), m_steps(0) { }
+
+  // Raise signal '2' when this function is called.
+  void bump() { m_bumped = true; signal(2); }
+
+ protected:
+  ~Sequence() override { }
+  char const* task_name_impl() const override { return "Sequence"; }
+  Body body() override;
+};
+
+statefultask::CoroutineTask::Body Sequence::body()
+{
+  auto start = std::chrono::steady_clock::now();
+  co_await sleep_for(threadpool::Interval<10, std::chrono::milliseconds>());
+  [[maybe_unused]] auto slept = std::chrono::steady_clock::now() - start;
+  ASSERT(slept >= std::chrono::milliseconds(10));
+  ++m_steps;
+  co_await yield_to(s_low_priority_queue);
+  ++m_steps;
+  co_await wait_until(2, [this](){ return m_bumped.load(); });
+  ++m_steps;
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  AIMemoryPagePool mpp;
+  AIThreadPool thread_pool;
+  s_high_priority_queue = thread_pool.new_queue(32);
+  s_low_priority_queue = thread_pool.new_queue(32);
+
+  // fib(18), with about eight thousand tasks.
+  {
+    utils::Gate finished;
+    bool success = false;
+    boost::intrusive_ptr<CoFibonacci> fibonacci = new CoFibonacci(18);
+    fibonacci->run(s_high_priority_queue, [&](bool s){ success = s; finished.open(); });
+    finished.wait();
+    ASSERT(success && fibonacci->value() == 4181);
+    std::cout << "fib(18) = " << fibonacci->value() << std::endl;
+  }
+
+  {
+    utils::Gate finished;
+    bool success = false;
+    boost::intrusive_ptr<Sequence> sequence = new Sequence;
+    sequence->run(s_high_priority_queue, [&](bool s){ success = s; finished.open(); });
+    // Bump it while it is probably still sleeping.
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    sequence->bump();
+    finished.wait();
+    ASSERT(success && sequence->m_steps == 3);
+    std::cout << "Sequence finished after " << sequence->m_steps << " steps." << std::endl;
+  }
+
+  // Before mpp is destroyed.
+  statefultask::TaskArena::flush_remote_frees();
+}
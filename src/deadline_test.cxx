@@ -0,0 +1,65 @@
+#include "sys.h"
+#include "threadpool/AIThreadPool.h"
+#include "utils/threading/Gate.h"
+#include "DeadlineQueue.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "debug.h"
+
+// Submit functors with random deadlines through a threadpool::DeadlineQueue while the
+// (single) pool thread is blocked, then unblock it and check that the functors ran in
+// the order of their deadline.
+
+namespace utils { using namespace threading; }
+
+int constexpr capacity = 1024;
+int constexpr number_of_functors = 1000;
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  AIThreadPool thread_pool(1);
+  AIQueueHandle queue_handle = thread_pool.new_queue(capacity);
+  threadpool::DeadlineQueue deadline_queue(thread_pool, queue_handle, capacity);
+
+  // Block the only thread of the pool.
+  utils::Gate blocked;
+  utils::Gate unblock;
+  {
+    auto queues_access = thread_pool.queues_read_access();
+    auto& queue = thread_pool.get_queue(queues_access, queue_handle);
+    queue.producer_access().move_in([&](){ blocked.open(); unblock.wait(); return false; });
+    queue.notify_one();
+  }
+  blocked.wait();
+
+  using clock_type = threadpool::DeadlineQueue::clock_type;
+  auto const start = clock_type::now();
+  std::mt19937 generator(42);
+  std::uniform_int_distribution<int> distribution(0, 1000000);
+  std::vector<int> order;                               // Only accessed by the pool thread until finished is open.
+  utils::Gate finished;
+  for (int n = 0; n < number_of_functors; ++n)
+  {
+    int const microseconds = distribution(generator);
+    bool submitted = deadline_queue.try_submit(start + std::chrono::microseconds(microseconds), [&order, microseconds](){
+        order.push_back(microseconds);
+        return false;
+      });
+    ASSERT(submitted);
+  }
+  // Runs last: its deadline is later than all the others.
+  deadline_queue.try_submit(start + std::chrono::seconds(2), [&finished](){ finished.open(); return false; });
+  unblock.open();
+  finished.wait();
+
+  bool sorted = std::is_sorted(order.begin(), order.end());
+  std::cout << "Ran " << order.size() << " functors " << (sorted ? "in" : "NOT in") << " deadline order; " <<
+    deadline_queue.missed() << " of " << deadline_queue.executed() << " missed their deadline (max lateness " <<
+    std::chrono::duration_cast<std::chrono::microseconds>(deadline_queue.max_lateness()).count() << " μs)." << std::endl;
+  return sorted ? 0 : 1;
+}
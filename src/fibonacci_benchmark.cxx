@@ -0,0 +1,133 @@
+#include "sys.h"
+#include "statefultask/AIStatefulTask.h"
+#include "statefultask/DefaultMemoryPagePool.h"
+#include "threadpool/AIThreadPool.h"
+#include "utils/threading/Gate.h"
+#include "ResultSink.h"
+#include "Fibonacci.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "debug.h"
+
+// The scheduling overhead of AIStatefulTask: compute fib(N) with one task per node of
+// the recursion tree (the Fibonacci task of fibonacci.cxx, see Fibonacci.h) and report
+// tasks per second and the overhead per task, as function of the number of threads of
+// the pool.
+//
+// Three variants are measured for every thread count:
+//   - every child task goes through the thread pool queue;
+//   - children are run inline, up to a depth budget (the default of fibonacci.cxx);
+//   - a plain std::async baseline that spawns asynchronous calls for the top of the
+//     tree (enough to keep all threads busy) and recurses with ordinary calls below.
+//
+// The overhead per task is the thread time that the tasks took in excess of the plain
+// recursive fib_sequential, divided by the number of tasks.
+//
+// The wall clock times are measured with std::chrono::steady_clock instead of a
+// benchmark::Stopwatch, because a Stopwatch pins the calling thread to one CPU and the
+// threads of the pool (and those of std::async) inherit the affinity of the main thread.
+//
+// Usage: fibonacci_benchmark [N]     (default 25, at most 30).
+
+namespace utils { using namespace threading; }
+
+int constexpr queue_capacity = 100000;
+
+int fib_sequential(int n)
+{
+  return n < 2 ? 1 : fib_sequential(n - 1) + fib_sequential(n - 2);
+}
+
+int fib_async(int n, int spawn_depth)
+{
+  if (n < 2)
+    return 1;
+  if (spawn_depth == 0)
+    return fib_sequential(n - 1) + fib_sequential(n - 2);
+  auto largest = std::async(std::launch::async, fib_async, n - 1, spawn_depth - 1);
+  int smallest = fib_async(n - 2, spawn_depth - 1);
+  return largest.get() + smallest;
+}
+
+// Returns the number of seconds that f() took.
+template<typename F>
+double measure(F f)
+{
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Returns the number of seconds it took to compute fib(n) with tasks.
+double measure_tasks(int n, int& value)
+{
+  utils::Gate finished;
+  boost::intrusive_ptr<Fibonacci> root = new Fibonacci(n);
+  double seconds = measure([&](){
+    root->run(Fibonacci::s_queue, [&finished](bool){ finished.open(); });
+    finished.wait();
+  });
+  value = root->value();
+  return seconds;
+}
+
+int main(int argc, char* argv[])
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  int const n = std::min(30, argc > 1 ? std::atoi(argv[1]) : 25);
+  int const expected = fib_sequential(n);
+  // The recursion tree of fib(n) has 2 * fib(n) - 1 nodes.
+  double const number_of_tasks = 2.0 * expected - 1;
+
+  // The same computation without tasks (best of three).
+  double sequential_s = 1e9;
+  for (int i = 0; i < 3; ++i)
+  {
+    [[maybe_unused]] volatile int sequential_value;
+    sequential_s = std::min(sequential_s, measure([&](){ sequential_value = fib_sequential(n); }));
+  }
+
+  AIMemoryPagePool mpp;
+  int const max_threads = std::thread::hardware_concurrency();
+  AIThreadPool thread_pool(1, max_threads);
+  Fibonacci::s_queue = thread_pool.new_queue(queue_capacity);
+
+  auto result_sink = benchmark::ResultSink::create();
+  result_sink->begin("fib(" + std::to_string(n) + "): " + std::to_string(static_cast<long>(number_of_tasks)) + " tasks", "threads", "million tasks per second");
+  for (int number_of_threads = 1; number_of_threads <= max_threads; ++number_of_threads)
+  {
+    thread_pool.change_number_of_threads_to(number_of_threads);
+
+    int value;
+    Fibonacci::s_inline = false;
+    double const queued_s = measure_tasks(n, value);
+    ASSERT(value == expected);
+    Fibonacci::s_inline = true;
+    double const inline_s = measure_tasks(n, value);
+    ASSERT(value == expected);
+
+    // Spawn depth: enough asynchronous calls to keep all threads busy (about four per thread).
+    int spawn_depth = 2;
+    while ((1 << spawn_depth) < 4 * number_of_threads)
+      ++spawn_depth;
+    [[maybe_unused]] int async_value;
+    double const async_s = measure([&](){ async_value = fib_async(n, spawn_depth); });
+    ASSERT(async_value == expected);
+
+    // The overhead per task: the total thread time minus the time of the sequential computation, divided by the number of tasks.
+    auto overhead_ns = [&](double seconds){ return (seconds * number_of_threads - sequential_s) * 1e9 / number_of_tasks; };
+    std::cout << number_of_threads << " threads: queued: " << number_of_tasks / queued_s * 1e-6 << " Mtasks/s (" << overhead_ns(queued_s) <<
+      " ns/task); inline: " << number_of_tasks / inline_s * 1e-6 << " Mtasks/s (" << overhead_ns(inline_s) <<
+      " ns/task); std::async: " << number_of_tasks / async_s * 1e-6 << " Mcalls/s." << std::endl;
+    result_sink->data_point(number_of_threads, number_of_tasks / queued_s * 1e-6, 0, "queued");
+    result_sink->data_point(number_of_threads, number_of_tasks / inline_s * 1e-6, 0, "inline");
+    result_sink->data_point(number_of_threads, number_of_tasks / async_s * 1e-6, 0, "std::async");
+  }
+  result_sink->end("linespoints");
+}
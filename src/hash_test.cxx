@@ -1,6 +1,7 @@
 #include "sys.h"
 #include "debug.h"
 #include "cwds/benchmark.h"
+#include "CpuFrequency.h"
 #include "resolver-task/AddressInfo.h"
 #include <farmhash.h>
 #include <vector>
@@ -13,7 +14,7 @@ struct Result
 
   void print(uint64_t CWDEBUG_ONLY(time_offset)) const
   {
-    Dout(dc::notice, "Thread on CPU #" << m_cpu << " started running at t = " << (m_start_cycles - time_offset) << " and ran for " << m_diff_cycles / 3612059050.0 << " seconds.");
+    Dout(dc::notice, "Thread on CPU #" << m_cpu << " started running at t = " << (m_start_cycles - time_offset) << " and ran for " << benchmark::CpuFrequency::seconds(m_diff_cycles) << " seconds.");
   }
 };
 
@@ -27,6 +28,7 @@ int main()
     benchmark::Stopwatch stopwatch(cpu);
     stopwatch.calibrate_overhead(1000, 3);
   }
+  benchmark::CpuFrequency::cycles_per_second();
 
   eda::FrequencyCounter<uint64_t, 8> fc;
   bool done = false;
@@ -54,7 +56,7 @@ int main()
     result.m_diff_cycles = stopwatch.diff_cycles();
     result.m_diff_cycles -= stopwatch.s_stopwatch_overhead;
 
-    uint64_t bucket = result.m_diff_cycles / 3612059.05;      // milliseconds.
+    uint64_t bucket = benchmark::CpuFrequency::milliseconds(result.m_diff_cycles);
     Dout(dc::notice, "Measured " << result.m_diff_cycles << " clock cycles (" << bucket << " milliseconds per " << loopsize << " Hash calls).\n");
     if (fc.add(bucket))
     {
@@ -4,6 +4,10 @@
 #include "statefultask/AIEngine.h"
 #include "evio/EventLoop.h"
 #include "utils/debug_ostream_operators.h"      // Needed to write error to Dout.
+#include "utils/threading/Gate.h"
+#include "EngineInputDevice.h"
+
+namespace utils { using namespace threading; }
 
 int main()
 {
@@ -19,25 +23,26 @@ int main()
   {
     evio::EventLoop event_loop(low_priority_queue);
     AIEngine engine("main engine", 2.0);
+    statefultask::EngineDriver engine_driver(engine, std::chrono::milliseconds(2));
+    // Let the event loop run the engine.
+    auto engine_device = evio::create<statefultask::EngineInputDevice>(engine_driver);
+    engine_device->init();
 
     auto task = statefultask::create<task::HelloWorld>();
     task->initialize(42);
 
-    bool test_finished = false;
+    utils::Gate test_finished;
     task->run(&engine, [&](bool CWDEBUG_ONLY(success)){
-        test_finished = true;
         Dout(dc::notice, "Inside the call-back (" << (success ? "success" : "failure") << ").");
+        test_finished.open();
     });
+    engine_driver.wake_up();
 
-    // Add an artificial main loop here.
-    while (!test_finished)
-    {
-      engine.mainloop();
-      // Pretend we're doing something else too.
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
+    // Wait until the task finished.
+    test_finished.wait();
 
     // Terminate application.
+    engine_device->close();
     event_loop.join();
   }
   catch (AIAlert::Error const& error)
@@ -6,7 +6,19 @@
 #include <atomic>
 #include <condition_variable>
 #include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
 #include "cwds/benchmark.h"
+#include "CpuFrequency.h"
+#include "LatencyCollector.h"
+#include "CpuTopology.h"
+#include "ResultSink.h"
+#include "threadsafe/AIReadWriteSpinLock.h"
+#include "utils/threading/SpinSemaphore.h"
+#include <x86intrin.h>
 #include "debug.h"
 
 int constexpr number_of_threads = 4;
@@ -19,26 +31,14 @@ std::atomic_flag block = ATOMIC_FLAG_INIT;
 // Pause instruction to prevent excess processor bus usage.
 #define cpu_relax() asm volatile("pause\n": : :"memory")
 
-struct Result
-{
-  int m_cpu;
-  uint64_t m_start_cycles;
-  uint64_t m_diff_cycles;
-
-  void print(uint64_t CWDEBUG_ONLY(time_offset)) const
-  {
-    Dout(dc::notice, "Thread on CPU #" << m_cpu << " started running at t = " << (m_start_cycles - time_offset) << " and ran for " << m_diff_cycles / 3612059050.0 << " seconds.");
-  }
-};
-
-struct SortResultByStartCycles
-{
-  bool operator()(Result const& a, Result const& b) { return a.m_start_cycles < b.m_start_cycles; }
-};
+// The time each thread needed for the whole test (one sample per thread per run),
+// and the time that each m.lock() took (the tail of which is what we're interested in).
+benchmark::LatencyCollector run_times(number_of_threads * skip_cores);
+benchmark::LatencyCollector lock_latency(number_of_threads * skip_cores);
 
 std::mutex m;
 
-void thread_main(int cpu, Result& result)
+void thread_main(int cpu, uint64_t& diff_cycles)
 {
   Debug(NAMESPACE_DEBUG::init_thread());
   Debug(dc::notice.off());
@@ -60,31 +60,180 @@ void thread_main(int cpu, Result& result)
   volatile int v __attribute__ ((unused));
   for (int i = 0; i < 240000 / number_of_threads; ++i)
   {
+    uint64_t before = __rdtsc();
     m.lock();
+    uint64_t latency = __rdtsc() - before;
     for (int j = 0; j < 550; ++j)
       v = j;
     m.unlock();
+    // Record the sample outside the critical section, so it doesn't lengthen it.
+    lock_latency.add(cpu, latency);
   }
 
   stopwatch.stop();
 
-  result.m_cpu = cpu;
-  result.m_start_cycles = stopwatch.start_cycles();
-  result.m_diff_cycles = stopwatch.diff_cycles();
-  result.m_diff_cycles -= stopwatch.s_stopwatch_overhead;
+  run_times.add(cpu, stopwatch);
+  diff_cycles = stopwatch.diff_cycles() - stopwatch.s_stopwatch_overhead;
 }
 
-int main()
+//-----------------------------------------------------------------------------
+// Sweep mode.
+//
+// Usage: mutex_benchmark --sweep [max_threads]
+//
+// Measures the throughput (lock/unlock pairs per second, summed over all threads) of
+// several lock types as function of the number of threads, for different placements
+// of those threads and different lengths of the critical section.
+//
+// AIStatefulTaskMutex is not part of the sweep: it can only be locked from a running
+// task (it is not a BasicLockable); see AIStatefulTaskMutex_test for that one.
+
+namespace utils { using namespace threading; }
+
+struct StdMutex
+{
+  static constexpr char const* name = "std::mutex";
+  std::mutex m_mutex;
+  void lock() { m_mutex.lock(); }
+  void unlock() { m_mutex.unlock(); }
+};
+
+// A binary semaphore used as lock.
+struct SpinSemaphoreLock
+{
+  static constexpr char const* name = "SpinSemaphore";
+  utils::SpinSemaphore m_semaphore;
+  SpinSemaphoreLock() { m_semaphore.post(1); }
+  void lock() { m_semaphore.wait(); }
+  void unlock() { m_semaphore.post(1); }
+};
+
+struct ReadWriteSpinLockWrite
+{
+  static constexpr char const* name = "AIReadWriteSpinLock(wr)";
+  AIReadWriteSpinLock m_lock;
+  void lock() { m_lock.wrlock(); }
+  void unlock() { m_lock.wrunlock(); }
+};
+
+struct ReadWriteSpinLockRead
+{
+  static constexpr char const* name = "AIReadWriteSpinLock(rd)";
+  AIReadWriteSpinLock m_lock;
+  void lock() { m_lock.rdlock(); }
+  void unlock() { m_lock.rdunlock(); }
+};
+
+int constexpr sweep_iterations = 20000;                 // Total number of lock/unlock pairs per measurement.
+int constexpr sweep_minimum_of = 3;                     // Use the fastest of this many measurements.
+int const critical_section_lengths[] = { 0, 50, 550, 2000 };
+benchmark::CpuTopology::Placement const placements[] = {
+  benchmark::CpuTopology::smt_siblings, benchmark::CpuTopology::same_l3, benchmark::CpuTopology::cross_package
+};
+
+// Run sweep_iterations lock/unlock pairs divided over one thread per cpu in cpus.
+// Returns the number of clock cycles between the first thread starting and the last thread finishing.
+template<typename LOCK>
+uint64_t sweep_run(LOCK& lock, std::vector<int> const& cpus, int critical_section_length)
+{
+  int const number_of_threads = cpus.size();
+  std::atomic_int ready = ATOMIC_VAR_INIT(0);
+  std::atomic_bool go = ATOMIC_VAR_INIT(false);
+  std::vector<uint64_t> start_cycles(number_of_threads);
+  std::vector<uint64_t> stop_cycles(number_of_threads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < number_of_threads; ++t)
+    threads.emplace_back([&, t](){
+      Debug(NAMESPACE_DEBUG::init_thread());
+      benchmark::Stopwatch stopwatch(cpus[t]);
+      ++ready;
+      while (!go.load(std::memory_order_acquire))
+        cpu_relax();
+      volatile int v __attribute__ ((unused));
+      stopwatch.start();
+      for (int i = 0; i < sweep_iterations / number_of_threads; ++i)
+      {
+        lock.lock();
+        for (int j = 0; j < critical_section_length; ++j)
+          v = j;
+        lock.unlock();
+      }
+      stopwatch.stop();
+      start_cycles[t] = stopwatch.start_cycles();
+      stop_cycles[t] = stopwatch.stop_cycles();
+    });
+  while (ready < number_of_threads)
+    cpu_relax();
+  go.store(true, std::memory_order_release);
+  for (auto& thread : threads)
+    thread.join();
+  return *std::max_element(stop_cycles.begin(), stop_cycles.end()) - *std::min_element(start_cycles.begin(), start_cycles.end());
+}
+
+template<typename LOCK>
+void sweep_lock(benchmark::ResultSink& sink, int max_threads)
+{
+  auto const& topology = benchmark::CpuTopology::instance();
+  LOCK lock;
+  for (auto placement : placements)
+  {
+    sink.begin(std::string(LOCK::name) + ", " + benchmark::CpuTopology::name(placement), "threads", "throughput (M lock/unlock per second)");
+    for (int critical_section_length : critical_section_lengths)
+    {
+      std::string const series = "critical section " + std::to_string(critical_section_length);
+      for (int number_of_threads = 1; number_of_threads <= max_threads; ++number_of_threads)
+      {
+        std::vector<int> cpus = topology.select(placement, number_of_threads);
+        if (static_cast<int>(cpus.size()) < number_of_threads)
+          break;                                        // Not enough cpu's for this placement.
+        uint64_t cycles = std::numeric_limits<uint64_t>::max();
+        for (int m = 0; m < sweep_minimum_of; ++m)
+          cycles = std::min(cycles, sweep_run(lock, cpus, critical_section_length));
+        int const iterations = sweep_iterations / number_of_threads * number_of_threads;
+        double throughput = iterations / benchmark::CpuFrequency::seconds(cycles) * 1e-6;
+        std::cout << std::left << std::setw(24) << LOCK::name << std::setw(14) << benchmark::CpuTopology::name(placement) <<
+          " cs = " << std::setw(5) << critical_section_length << " threads = " << std::setw(3) << number_of_threads <<
+          std::right << std::fixed << std::setprecision(3) << std::setw(10) << throughput << " M/s" << std::endl;
+        sink.data_point(number_of_threads, throughput, 0, series);
+      }
+    }
+    sink.end("linespoints");
+  }
+}
+
+void sweep(int max_threads)
+{
+  auto const& topology = benchmark::CpuTopology::instance();
+  if (max_threads <= 0)
+    max_threads = topology.number_of_cpus();
+  auto sink = benchmark::ResultSink::create();
+  sweep_lock<StdMutex>(*sink, max_threads);
+  sweep_lock<SpinSemaphoreLock>(*sink, max_threads);
+  sweep_lock<ReadWriteSpinLockWrite>(*sink, max_threads);
+  sweep_lock<ReadWriteSpinLockRead>(*sink, max_threads);
+}
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
 {
   Debug(NAMESPACE_DEBUG::init());
 
   std::array<std::thread, number_of_threads> threads;
-  std::array<Result, number_of_threads> results;
+  std::array<uint64_t, number_of_threads> results;
 
   {
     benchmark::Stopwatch stopwatch(0);
     stopwatch.calibrate_overhead(1000, 3);
   }
+  // Calibrate (or load) the TSC frequency before starting any measurement.
+  benchmark::CpuFrequency::cycles_per_second();
+
+  if (argc > 1 && std::strcmp(argv[1], "--sweep") == 0)
+  {
+    sweep(argc > 2 ? std::atoi(argv[2]) : 0);
+    return 0;
+  }
 
   eda::FrequencyCounter<uint64_t, 8> fc;
   bool done = false;
@@ -120,9 +269,9 @@ int main()
     for (auto&& thread : threads)
       thread.join();
 
-    for (auto&& result : results)
+    for (uint64_t diff_cycles : results)
     {
-      uint64_t bucket = result.m_diff_cycles / 3612059.05;      // milliseconds.
+      uint64_t bucket = benchmark::CpuFrequency::milliseconds(diff_cycles);
       //Dout(dc::notice, "Adding " << bucket);
       if (fc.add(bucket))
       {
@@ -138,4 +287,9 @@ int main()
     std::cout << "Result: " << fc.result().m_cycles << std::endl;
   else
     std::cout << "Result: " << fc.average() << std::endl;
+
+  std::cout << "Time per thread per run:\n";
+  run_times.print_on(std::cout);
+  std::cout << "Time needed to obtain the lock:\n";
+  lock_latency.print_on(std::cout);
 }
@@ -1,4 +1,4 @@
-// Compile as: g++ -std=c++14 -I.. -D_GNU_SOURCE -O2 -pthread mutex_test.cxx -lboost_iostreams -lboost_system
+// Compile as: g++ -std=c++14 -I.. -D_GNU_SOURCE -O2 -pthread mutex_test.cxx ResultSink.cxx -lboost_iostreams -lboost_system
 
 #include <iostream>
 #include <thread>
@@ -11,10 +11,12 @@
 #include <condition_variable>
 #include <cmath>
 #include <map>
+#include <memory>
+#include <string>
 #include <pthread.h>
 #include <boost/tuple/tuple.hpp>
 #include <boost/math/distributions/students_t.hpp>
-#include "cwds/gnuplot_tools.h"
+#include "ResultSink.h"
 
 int constexpr cachelinesize = 64;
 int constexpr loopsize = 100000;
@@ -73,18 +75,17 @@ using time_point = clock_type::time_point;
 
 std::atomic_int ready = ATOMIC_VAR_INIT(0);
 
-eda::Plot plot("Number of clocks it takes to lock/unlock a mutex as function of frequency (in ns).",
-          "Interval between calls to the lock/unlock pair (in ns)",
-          "Time to lock and unlock a mutex (in clks)");
+// Set BENCHMARK_OUTPUT=json or csv to get machine readable output (see ResultSink::create).
+std::unique_ptr<benchmark::ResultSink> const result_sink = benchmark::ResultSink::create();
 std::mutex all_mutex;
 std::array<int, 300> max_clks_all;
 std::array<int, 300> min_clks_all;
 int max_repeats;
 
-void benchmark(int thread, int test_nr, int repeats, std::string desc, uint64_t (*func)(int, int), int loop_count)
+void run_benchmark(int thread, int test_nr, int repeats, std::string desc, uint64_t (*func)(int, int), int loop_count)
 {
   iomutex.lock();
-  std::cout << "Calling benchmark(" << thread << ", " << test_nr << ", " << repeats << ", \"" << desc << "\", func, " << loop_count << ")" << std::endl;
+  std::cout << "Calling run_benchmark(" << thread << ", " << test_nr << ", " << repeats << ", \"" << desc << "\", func, " << loop_count << ")" << std::endl;
   iomutex.unlock();
   if (thread == 0)
     max_repeats = repeats;
@@ -198,11 +199,12 @@ void benchmark(int thread, int test_nr, int repeats, std::string desc, uint64_t
   std::lock_guard<std::mutex> lk(iomutex);
   std::cout << "===Thread #" << thread << "==================================================================================\n";
   std::cout << "Description: " << repeats << ' ' << desc << "\n";
-  std::cout << "Time: " << data_ns_result.first << " ± " << data_ns_result.second << " ns (99.9% confidence interval).\n";
-  std::cout << "Clocks: " << clocks_result.first << " ± " << clocks_result.second << " (99% confidence interval).\n";
+  std::string const name = "Thread #" + std::to_string(thread) + ", " + std::to_string(repeats) + ' ' + desc;
+  result_sink->confidence_interval(name + ", time (ns)", data_ns_result.first, data_ns_result.second, 99.9);
+  result_sink->confidence_interval(name + ", clocks", clocks_result.first, clocks_result.second, 99.9);
 
-  plot.add_data_point(data_ns_result.first, clocks_result.first, clocks_result.second, "CPU #" + std::to_string(thread));
-  //plot.add_data_point((double)repeats, clocks_result.first, clocks_result.second, "CPU #" + std::to_string(thread) + "(clks)");
+  result_sink->data_point(data_ns_result.first, clocks_result.first, clocks_result.second, "CPU #" + std::to_string(thread));
+  //result_sink->data_point((double)repeats, clocks_result.first, clocks_result.second, "CPU #" + std::to_string(thread) + "(clks)");
 }
 
 std::atomic_int count = ATOMIC_VAR_INIT(0);
@@ -216,7 +218,7 @@ void run(int thread)
   for (int loop_count = 1000; loop_count >= 30; loop_count -= 2)
   {
     ++test_nr;
-    benchmark(thread, test_nr, loop_count, "dec", do_Ndec, loop_count);
+    run_benchmark(thread, test_nr, loop_count, "dec", do_Ndec, loop_count);
     count.fetch_add(1);
     while (count.load() < test_nr * num_threads);
   }
@@ -231,6 +233,9 @@ int main()
 {
   for (int i = 0; i < min_clks_all.size(); ++i)
     min_clks_all[i] = 1000000;
+  result_sink->begin("Number of clocks it takes to lock/unlock a mutex as function of frequency (in ns).",
+      "Interval between calls to the lock/unlock pair (in ns)",
+      "Time to lock and unlock a mutex (in clks)");
   std::array<std::thread, num_threads> threads;
   for (int t = 0; t < num_threads; ++t)
   {
@@ -246,12 +251,9 @@ int main()
   }
   for (int t = 0; t < num_threads; ++t)
     threads[t].join();
-  if (plot.has_data())
-  {
-    //plot.set_xrange(125, 150 /*max_repeats + 1*/);
-    //plot.set_yrange(150, 250 /*max_repeats + 1*/);
-    plot.show("errorbars");
-  }
+  //result_sink->gnuplot_command("set xrange [125:150]");
+  //result_sink->gnuplot_command("set yrange [150:250]");
+  result_sink->end("errorbars");
 }
 
 struct B {
@@ -4,6 +4,8 @@
 #include "tracked.h"
 #endif
 #include "threadpool/AIObjectQueue.h"
+#include "SpillingQueue.h"
+#include "InlineFunction.h"
 #include <mutex>
 #include <atomic>
 #include <functional>
@@ -164,4 +166,69 @@ int main()
     Dout(dc::notice|continued_cf, "Destructing AIObjectQueue<" << name_F << "> object_queue... ");
   }
   Dout(dc::finish, "destructed.");
+
+  {
+    // A full SpillingObjectQueue spills into its SpillList, and the order is kept.
+    threadpool::SpillingObjectQueue<F> spilling_queue;
+    spilling_queue.reallocate(2);
+    int constexpr n = 200;                      // More than a few SpillList segments.
+    int next = 0;
+    for (int i = 0; i < n; ++i)
+    {
+      spilling_queue.move_in([i, &next](){ ASSERT(next == i); ++next; });
+      // Interleave some consumption.
+      F f;
+      if (i % 3 == 0 && spilling_queue.move_out(f))
+        f();
+    }
+    ASSERT(spilling_queue.spilled() > 0);
+    F f;
+    while (spilling_queue.move_out(f))
+      f();
+    ASSERT(next == n);
+    ASSERT(spilling_queue.spilled() == 0);
+    Dout(dc::notice, "SpillingObjectQueue kept the order of " << n << " elements.");
+  }
+
+  {
+    // An AIObjectQueue of move-only callables with inline storage: no heap allocation per element.
+    using Function = threadpool::InlineFunction<void()>;
+    static_assert(sizeof(Function) == 64 && alignof(Function) == 64, "Every queue slot should be exactly one cache line.");
+    // Big + a function pointer doesn't fit in 48 bytes; use 112 bytes of storage (two cache lines) or the heap.
+    using BigFunction = threadpool::InlineFunction<void(), 112, true>;
+
+    AIObjectQueue<Function> function_queue;
+    function_queue.reallocate(4);
+    AIObjectQueue<BigFunction> big_function_queue;
+    big_function_queue.reallocate(4);
+
+    int sum = 0;
+    auto small = [&sum, a = 1, b = 2, c = 3](){ sum += a + b + c; };
+    static_assert(Function::fits_inline<decltype(small)>);
+    {
+      auto pa = function_queue.producer_access();
+      for (int i = 0; i < 4; ++i)
+        pa.move_in(Function(small));
+    }
+    {
+      auto pa = big_function_queue.producer_access();
+      Big b;
+      pa.move_in(BigFunction(std::bind(f, b)));
+    }
+    {
+      auto ca = function_queue.consumer_access();
+      while (ca.length() > 0)
+      {
+        Function function(ca.move_out());
+        function();
+      }
+    }
+    {
+      auto ca = big_function_queue.consumer_access();
+      BigFunction function(ca.move_out());
+      function();
+    }
+    ASSERT(sum == 24);
+    Dout(dc::notice, "InlineFunction queue test done.");
+  }
 }
@@ -13,8 +13,9 @@
 
 #ifdef BENCHMARK
 #include "cwds/benchmark.h"
+#include "CpuFrequency.h"
+#include "LatencyCollector.h"
 
-double const cpu_frequency = 3612059050.0;      // In cycles per second.
 int const cpu = 8;
 size_t const loopsize = 1000;                   // We'll be measing the number of clock cylces needed for this many iterations of the test code.
 size_t const minimum_of = 3;                    // All but the fastest measurement of this many measurements are thrown away (3 is normally enough).
@@ -44,6 +45,13 @@ void f(A* a)
 using PS = threadsafe::PointerStorage<A>;
 PS ps(2000);
 
+constexpr int number_of_threads = 16;
+
+#ifdef BENCHMARK
+// The number of clock cycles that ps.insert needed, per thread (each thread runs on its own cpu).
+benchmark::LatencyCollector insert_latency(number_of_threads);
+#endif
+
 #ifdef CWDEBUG
 // Initialization code for new threads.
 void init_debug(int thread)
@@ -62,8 +70,6 @@ void thread(int n, std::vector<PS::index_type>* positions, std::vector<int> cons
 
 #ifdef BENCHMARK
   benchmark::Stopwatch stopwatch(n);          // Declare stopwatch and configure on which CPU it must run.
-  size_t msum = 0;
-  size_t insert_count = 0;
 #endif
 
   for (int j = 0; j < rn.size(); ++j)
@@ -82,8 +88,7 @@ void thread(int n, std::vector<PS::index_type>* positions, std::vector<int> cons
         int index = ps.insert(a);
 #ifdef BENCHMARK
         stopwatch.stop();
-        msum += stopwatch.diff_cycles();
-        ++insert_count;
+        insert_latency.add(n, stopwatch);
 #endif
         positions->push_back(index);
       }
@@ -102,9 +107,6 @@ void thread(int n, std::vector<PS::index_type>* positions, std::vector<int> cons
     }
     ASSERT(positions->size() == target);
   }
-#ifdef BENCHMARK
-  Dout(dc::notice, "Average insert time: " << (msum / insert_count) << " clock cycles (" << (msum / insert_count / cpu_frequency * 1e9) << " ns).");
-#endif
 }
 
 int main()
@@ -116,9 +118,11 @@ int main()
 
   // Calibrate Stopwatch overhead.
   stopwatch.calibrate_overhead(loopsize, minimum_of);
+
+  // Determine the TSC frequency before starting the threads.
+  benchmark::CpuFrequency::cycles_per_second();
 #endif
 
-  constexpr int number_of_threads = 16;
   constexpr int number_of_random_numbers_per_thread = 100000;
 
   std::random_device rd;
@@ -139,6 +143,11 @@ int main()
 
   ASSERT(!ps.debug_empty());
 
+#ifdef BENCHMARK
+  std::cout << "PointerStorage::insert:\n";
+  insert_latency.print_on(std::cout);
+#endif
+
   int total = 0;
   for (int t = 0; t < threads.size(); ++t)
   {
@@ -2,6 +2,7 @@
 #include "resolver-task/DnsResolver.h"
 #include "evio/EventLoop.h"
 #include "cwds/benchmark.h"
+#include "CpuFrequency.h"
 #include "debug.h"
 
 using resolver::DnsResolver;
@@ -15,6 +16,7 @@ int main()
     benchmark::Stopwatch stopwatch(cpu);
     stopwatch.calibrate_overhead(1000, 3);
   }
+  benchmark::CpuFrequency::cycles_per_second();
   benchmark::Stopwatch stopwatch(cpu);
 
   AIThreadPool thread_pool;
@@ -36,7 +38,7 @@ int main()
 
   uint64_t diff_cycles = stopwatch.diff_cycles();
   diff_cycles -= stopwatch.s_stopwatch_overhead;
-  double milliseconds = diff_cycles / 3612059.05;
+  double milliseconds = benchmark::CpuFrequency::milliseconds(diff_cycles);
   std::cout << "Used time (uncached): " << milliseconds << " ms." << std::endl;
 
   stopwatch.start();
@@ -50,7 +52,7 @@ int main()
 
   diff_cycles = stopwatch.diff_cycles();
   diff_cycles -= stopwatch.s_stopwatch_overhead;
-  milliseconds = diff_cycles / 3612059.05;
+  milliseconds = benchmark::CpuFrequency::milliseconds(diff_cycles);
   std::cout << "Used time (cached): " << milliseconds << " ms." << std::endl;
 
   for (int proto_nr = 0; proto_nr < 256; ++proto_nr)
@@ -0,0 +1,153 @@
+#include "sys.h"
+#include "threadpool/AIObjectQueue.h"
+#include "cwds/benchmark.h"
+#include "CpuFrequency.h"
+#include "ResultSink.h"
+#include "LockFreeQueues.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "debug.h"
+
+// Compare the throughput of AIObjectQueue (a producer lock and a consumer lock) with
+// the lock-free threadpool::SPSCQueue and threadpool::MPMCQueue, for 1, 4 and 16
+// producer threads and a single consumer thread.
+//
+// Every producer moves in its share of number_of_elements; the time is measured by the
+// consumer, from releasing the producers until it moved out the last element.
+
+namespace utils { using namespace threading; }
+
+int constexpr capacity = 1024;
+int constexpr number_of_elements = 1 << 22;
+int constexpr number_of_runs = 5;                       // The minimum of these is reported.
+int constexpr cpu = 0;
+
+static inline void cpu_relax()
+{
+  asm volatile ("pause" ::: "memory");
+}
+
+// AIObjectQueue with the interface of the lock-free queues.
+class LockedQueue
+{
+ private:
+  AIObjectQueue<long> m_queue;
+
+ public:
+  LockedQueue(int capacity) { m_queue.reallocate(capacity); }
+
+  bool try_push(long&& element)
+  {
+    auto producer_access = m_queue.producer_access();
+    if (producer_access.length() >= m_queue.capacity())
+      return false;
+    producer_access.move_in(std::move(element));
+    return true;
+  }
+
+  bool try_pop(long& element)
+  {
+    auto consumer_access = m_queue.consumer_access();
+    if (consumer_access.length() == 0)
+      return false;
+    element = consumer_access.move_out();
+    return true;
+  }
+};
+
+// QUEUE must have bool try_push(long&&) and bool try_pop(long&).
+// Returns the number of nanoseconds per element.
+template<typename QUEUE>
+double measure(int number_of_producers)
+{
+  QUEUE queue(capacity);
+  int const per_producer = number_of_elements / number_of_producers;
+  std::atomic_bool go = false;
+  std::vector<std::thread> producers;
+  for (int p = 0; p < number_of_producers; ++p)
+    producers.emplace_back([&queue, &go, per_producer](){
+        while (!go.load(std::memory_order_acquire))
+          cpu_relax();
+        for (long i = 1; i <= per_producer; ++i)
+          while (!queue.try_push(long{i}))
+            cpu_relax();
+      });
+
+  // The consumer pins itself to cpu; it runs in its own thread so that the main thread,
+  // which creates the producers, is never pinned (threads inherit the affinity of the
+  // thread that creates them).
+  long const total = static_cast<long>(per_producer) * number_of_producers;
+  long sum = 0;
+  uint64_t cycles;
+  std::thread consumer([&](){
+      benchmark::Stopwatch stopwatch(cpu);
+      long element;
+      stopwatch.start();
+      go.store(true, std::memory_order_release);
+      for (long received = 0; received < total;)
+      {
+        if (queue.try_pop(element))
+        {
+          sum += element;
+          ++received;
+        }
+        else
+          cpu_relax();
+      }
+      stopwatch.stop();
+      cycles = stopwatch.diff_cycles();
+    });
+  consumer.join();
+
+  for (auto& producer : producers)
+    producer.join();
+  // Every producer sent 1 + 2 + ... + per_producer.
+  ASSERT(sum == number_of_producers * (static_cast<long>(per_producer) * (per_producer + 1) / 2));
+  return benchmark::CpuFrequency::nanoseconds(cycles) / total;
+}
+
+template<typename QUEUE>
+double best_of(int number_of_producers)
+{
+  double best = measure<QUEUE>(number_of_producers);
+  for (int run = 1; run < number_of_runs; ++run)
+    best = std::min(best, measure<QUEUE>(number_of_producers));
+  return best;
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  // Calibrate in a helper thread: a Stopwatch pins the thread that creates it.
+  std::thread calibration([](){
+      benchmark::Stopwatch stopwatch(cpu);
+      stopwatch.calibrate_overhead(1000, 3);
+      benchmark::CpuFrequency::cycles_per_second();
+    });
+  calibration.join();
+
+  auto result_sink = benchmark::ResultSink::create();
+  result_sink->begin("Queue throughput (capacity " + std::to_string(capacity) + ", one consumer)", "producers", "time per element (ns)");
+  for (int number_of_producers : { 1, 4, 16 })
+  {
+    double locked_ns = best_of<LockedQueue>(number_of_producers);
+    double mpmc_ns = best_of<threadpool::MPMCQueue<long>>(number_of_producers);
+    std::cout << number_of_producers << " producers: AIObjectQueue: " << locked_ns << " ns; MPMCQueue: " << mpmc_ns << " ns";
+    result_sink->data_point(number_of_producers, locked_ns, 0, "AIObjectQueue");
+    result_sink->data_point(number_of_producers, mpmc_ns, 0, "MPMCQueue");
+    if (number_of_producers == 1)
+    {
+      double spsc_ns = best_of<threadpool::SPSCQueue<long>>(number_of_producers);
+      std::cout << "; SPSCQueue: " << spsc_ns << " ns";
+      result_sink->data_point(number_of_producers, spsc_ns, 0, "SPSCQueue");
+    }
+    std::cout << " per element." << std::endl;
+  }
+  result_sink->end("linespoints");
+}
@@ -0,0 +1,80 @@
+#include "sys.h"
+#include "threadpool/AIThreadPool.h"
+#include "ResultSink.h"
+#include "QueueTable.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "debug.h"
+
+// Measure the cost of looking up an AIThreadPool queue from many threads at once:
+// thread_pool.queues_read_access() + get_queue() versus threadpool::QueueTable::with_queue().
+//
+// Only the lookup is measured; the queue itself is not accessed (that would add the
+// contention of its producer lock).
+
+namespace utils { using namespace threading; }
+
+using clock_type = std::chrono::steady_clock;
+
+int constexpr capacity = 32;
+int constexpr lookups_per_thread = 1000000;
+
+std::atomic<void*> sink;                                // Prevent the lookups from being optimized away.
+
+// Returns the average number of nanoseconds per lookup.
+template<typename LOOKUP>
+double measure(int number_of_threads, LOOKUP lookup)
+{
+  std::atomic_int ready = 0;
+  std::atomic_bool go = false;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < number_of_threads; ++t)
+    threads.emplace_back([&](){
+        ++ready;
+        while (!go.load(std::memory_order_acquire))
+          std::this_thread::yield();
+        void* last = nullptr;
+        for (int n = 0; n < lookups_per_thread; ++n)
+          last = lookup();
+        sink.store(last, std::memory_order_relaxed);
+      });
+  while (ready < number_of_threads)
+    std::this_thread::yield();
+  auto start = clock_type::now();
+  go.store(true, std::memory_order_release);
+  for (auto& thread : threads)
+    thread.join();
+  auto stop = clock_type::now();
+  return std::chrono::duration<double, std::nano>(stop - start).count() / lookups_per_thread;
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  AIThreadPool thread_pool(1);
+  threadpool::QueueTable queue_table(thread_pool);
+  AIQueueHandle queue_handle = queue_table.new_queue(capacity);
+
+  auto result_sink = benchmark::ResultSink::create();
+  result_sink->begin("Queue lookup", "threads", "wall clock time per lookup per thread (ns)");
+  int const max_threads = std::max(32U, std::thread::hardware_concurrency());
+  for (int number_of_threads = 1; number_of_threads <= max_threads; number_of_threads *= 2)
+  {
+    double locked_ns = measure(number_of_threads, [&](){
+        auto queues_access = thread_pool.queues_read_access();
+        return static_cast<void*>(&thread_pool.get_queue(queues_access, queue_handle));
+      });
+    double table_ns = measure(number_of_threads, [&](){
+        return queue_table.with_queue(queue_handle, [](auto& queue){ return static_cast<void*>(&queue); });
+      });
+    std::cout << number_of_threads << " threads: queues_read_access: " << locked_ns << " ns; QueueTable: " << table_ns << " ns." << std::endl;
+    result_sink->data_point(number_of_threads, locked_ns, 0, "queues_read_access");
+    result_sink->data_point(number_of_threads, table_ns, 0, "QueueTable");
+  }
+  result_sink->end("linespoints");
+}
@@ -2,6 +2,7 @@
 #include "resolver-task/DnsResolver.h"
 #include "evio/EventLoop.h"
 #include "cwds/benchmark.h"
+#include "CpuFrequency.h"
 #include "debug.h"
 
 using namespace resolver;
@@ -15,6 +16,7 @@ int main()
     benchmark::Stopwatch stopwatch(cpu);
     stopwatch.calibrate_overhead(1000, 3);
   }
+  benchmark::CpuFrequency::cycles_per_second();
   benchmark::Stopwatch stopwatch(cpu);
 
   AIThreadPool thread_pool;
@@ -53,7 +55,7 @@ int main()
 
     uint64_t diff_cycles = stopwatch.diff_cycles();
     diff_cycles -= stopwatch.s_stopwatch_overhead;
-    double milliseconds = diff_cycles / 3612059.05;
+    double milliseconds = benchmark::CpuFrequency::milliseconds(diff_cycles);
     std::cout << "Used time (" << (n ? "cached" : "uncached") << "): " << milliseconds << " ms." << std::endl;
   }
 
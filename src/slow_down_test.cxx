@@ -6,6 +6,8 @@
 #include "threadpool/AIThreadPool.h"
 #include "utils/AIAlert.h"
 #include "utils/debug_ostream_operators.h"
+#include "PoolPlacement.h"
+#include "RunAll.h"
 #include <chrono>
 #include "debug.h"
 
@@ -14,7 +16,8 @@ namespace utils { using namespace threading; }
 // Open the gate to terminate application.
 utils::Gate gate;
 
-int main()
+// Usage: slow_down_test [compact|scatter|per_node|<cpu list>]
+int main(int argc, char* argv[])
 {
   Debug(debug::init());
   Dout(dc::notice, "Entering main()");
@@ -30,15 +33,18 @@ int main()
   // Create the thread pool.
   AIThreadPool thread_pool(number_of_threads, max_number_of_threads);
   Debug(thread_pool.set_color_functions([](int color){ std::string code{"\e[30m"}; code[3] = '1' + color; return code; }));
+  // The queue used to pin the threads; as highest priority queue it can be run by every thread.
+  AIQueueHandle placement_queue = thread_pool.new_queue(number_of_threads);
   // And the thread pool queues.
   [[maybe_unused]] AIQueueHandle high_priority_queue   = thread_pool.new_queue(queue_capacity, reserved_threads);
   [[maybe_unused]] AIQueueHandle medium_priority_queue = thread_pool.new_queue(queue_capacity, reserved_threads);
                    AIQueueHandle low_priority_queue    = thread_pool.new_queue(queue_capacity);
+  // Pin the threads of the pool.
+  threadpool::PoolPlacement(threadpool::PoolPlacement::from_string(argc > 1 ? argv[1] : "compact")).apply(thread_pool, placement_queue, number_of_threads);
 
   // Main application begin.
   try
   {
-    std::atomic_int finished_counter = 0;
     constexpr int number_of_tasks = 30;
 
     std::array<boost::intrusive_ptr<task::HelloWorld>, number_of_tasks> tasks;
@@ -49,17 +55,12 @@ int main()
       tasks[i]->initialize(42 + i);
     }
 
+    statefultask::run_all(tasks, low_priority_queue, [](bool CWDEBUG_ONLY(success)){
+        Dout(dc::notice, "All " << number_of_tasks << " tasks finished (" << (success ? "success" : "failure") << ").");
+        gate.open();
+    });
 
-    for (int i = 0; i < number_of_tasks; ++i)
-    {
-      tasks[i]->run(low_priority_queue, [&, i](bool CWDEBUG_ONLY(success)){
-          Dout(dc::notice, "Inside the call-back of task " << i << " (" << (success ? "success" : "failure") << ").");
-          if (finished_counter++ == number_of_tasks - 1)
-            gate.open();
-      });
-    }
-
-    // Wait till both callbacks have been called.
+    // Wait till all tasks finished.
     gate.wait();
   }
   catch (AIAlert::Error const& error)
@@ -3,6 +3,7 @@
 #include "utils/threading/SpinSemaphore.h"
 #include "utils/macros.h"
 //#include "cwds/benchmark.h"
+//#include "CpuFrequency.h"
 #include "cwds/gnuplot_tools.h"
 #include <thread>
 #include <vector>
@@ -110,7 +111,7 @@ void triggers()
 
 #if 0
     uint64_t dc = sw.diff_cycles();
-    if (dc < 5 * 3612.05)
+    if (benchmark::CpuFrequency::microseconds(dc) < 5)
     {
       diff_cycles_sum += dc;
       ++cnt;
@@ -132,7 +133,7 @@ void triggers()
 #endif
   }
 
-//  std::cout << "Ran on average for " << diff_cycles_sum / 3.612059050 / cnt <<
+//  std::cout << "Ran on average for " << benchmark::CpuFrequency::nanoseconds(diff_cycles_sum) / cnt <<
 //    " nanoseconds (with " << (number_of_times_to_post_per_trigger - cnt) << " outliers)." << std::endl;
 }
 
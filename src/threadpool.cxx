@@ -1,8 +1,11 @@
 #include "sys.h"
 #include "threadpool/AIThreadPool.h"
 #include "utils/threading/Gate.h"
+#include "SpillingQueue.h"
+#include "QueueStats.h"
 #include "debug.h"
 #include <chrono>
+#include <iostream>
 
 namespace utils { using namespace threading; }
 
@@ -77,4 +80,49 @@ int main()
   }
   std::cout << "Added " << count << " tasks to the queue." << std::endl;
   std::cout << "Expected: " << ((loop_size - full) * modulo / (modulo - 1)) << std::endl;
+
+  // The same without any delay, through an OverflowQueue: nothing is dropped and the producer never waits.
+  count = 0;
+  {
+    AIThreadPool thread_pool(6);
+    AIQueueHandle queue_handle1 = thread_pool.new_queue(capacity);
+    threadpool::OverflowQueue overflow(thread_pool, queue_handle1, capacity);
+    size_t max_spilled = 0;
+    for (int n = 0; n < loop_size; ++n)
+    {
+      overflow.submit([&count](){ int c = count++; return c % modulo == 0; });
+      max_spilled = std::max(max_spilled, overflow.spilled());
+    }
+    utils::Gate finished;
+    overflow.submit([&finished](){ finished.open(); return false; });
+    finished.wait();
+    Dout(dc::notice, "Maximum number of spilled functors: " << max_spilled);
+  }
+  std::cout << "Added " << count << " tasks to the overflow queue." << std::endl;
+  std::cout << "Expected: " << (loop_size * modulo / (modulo - 1)) << std::endl;
+
+  // The same as the first test, but measured with QueueStats instead of the full/empty counters.
+  count = 0;
+  {
+    benchmark::CpuFrequency::cycles_per_second();       // Calibrate before the measurement.
+    AIThreadPool thread_pool(6);
+    AIQueueHandle queue_handle1 = thread_pool.new_queue(capacity);
+    threadpool::QueueStats stats(thread_pool, queue_handle1, capacity);
+    double delay = 200.0;
+    for (int n = 0; n < loop_size; ++n)
+    {
+      stats.try_submit([&count](){ int c = count++; return c % modulo == 0; });
+      int length = stats.pending();
+      delay *= 1.0 + (0.002 * std::min(length, capacity) / capacity - 0.001);
+      size_t cnt = delay;
+      for (size_t i = 0; i < cnt; ++i)
+        vv = 1;
+    }
+    utils::Gate finished;
+    while (!stats.try_submit([&finished](){ finished.open(); return false; }))
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    finished.wait();
+    stats.snapshot().print_on(std::cout);
+    std::cout << std::endl;
+  }
 }
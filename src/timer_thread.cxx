@@ -1,6 +1,7 @@
 #include "sys.h"
 #include "threadpool/AIThreadPool.h"
 #include "threadpool/Timer.h"
+#include "BatchSubmit.h"
 #include "debug.h"
 
 int const queue_size = 32;
@@ -19,24 +20,13 @@ class Callback
 void Callback::callback() const
 {
   Dout(dc::notice|flush_cf, "Timer " << m_nr << " expired.");
-  int added_tasks = 0;
   auto queues_access = AIThreadPool::instance().queues_read_access();
   auto& queue = AIThreadPool::instance().get_queue(queues_access, m_queue_handle);
-  {
-    auto queue_access = queue.producer_access();
-    int length = queue_access.length();
-    if (length < queue_size)
-    {
-      added_tasks = std::min(queue_size - length, 10 * (m_nr + 1));
-      for (int i = 0; i < added_tasks; ++ i)
-      {
-        queue_access.move_in([CWDEBUG_ONLY(this, i)](){ Dout(dc::notice, "Pool executed task #" << i << " added by callback of timer " << m_nr); return false; });
-        Dout(dc::notice, "Added task #" << i << " to queue " << m_queue_handle);
-      }
-    }
-  }
-  for (int i = 0; i < added_tasks; ++ i)
-    queue.notify_one();
+  [[maybe_unused]] int added_tasks = threadpool::submit_batch(queue, queue_size, 10 * (m_nr + 1), [CWDEBUG_ONLY(this)](int CWDEBUG_ONLY(i)){
+      Dout(dc::notice, "Adding task #" << i << " to queue " << m_queue_handle);
+      return [CWDEBUG_ONLY(this, i)](){ Dout(dc::notice, "Pool executed task #" << i << " added by callback of timer " << m_nr); return false; };
+    });
+  Dout(dc::notice, "Added " << added_tasks << " tasks to queue " << m_queue_handle);
 }
 
 #define SIMPLE 0
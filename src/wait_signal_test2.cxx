@@ -1,14 +1,20 @@
 #include "sys.h"
 #include "utils/MultiLoop.h"
+#include "ConditionWord.h"
 #include <exception>
 #include <iostream>
 #include <bitset>
 #include <array>
 #include <cassert>
+#include <cstdlib>
 #include <sstream>
 #include <fstream>
 #include <map>
 #include <set>
+#include <atomic>
+#include <semaphore>
+#include <thread>
+#include <vector>
 
 struct NotAllowed : std::exception
 {
@@ -205,15 +211,124 @@ std::string operation_str(int operation)
   return result;
 }
 
+// The four counters of the model are conditions 0 to 3 of a ConditionWord; the other conditions are running (1).
+statefultask::ConditionWord::condition_type constexpr required_conditions = 0b1100;
+
+statefultask::ConditionWord::word_type to_word(state_type st)
+{
+  statefultask::ConditionWord::word_type word = statefultask::ConditionWord::running_word & ~0xffU;
+  int p = 1;
+  for (int i = 0; i < 4; ++i)
+  {
+    word |= ((st / p) % 3) << (2 * i);
+    p *= 3;
+  }
+  return word;
+}
+
+// Compare the transitions of ConditionWord with those of the model, for every state and operation that the model allows.
+int check_transition_table(std::array<std::array<int, 32>, 81> const& graph, std::array<std::array<bool, 32>, 81> const& woken, int not_allowed_magic)
+{
+  using statefultask::ConditionWord;
+  int errors = 0;
+  int checked = 0;
+  for (state_type s = 0; s < 81; ++s)
+  {
+    Task task;
+    task.set_state(s);
+    bool const running = !task.has_idle_counter();
+    for (int operation = 1; operation < 32; ++operation)
+    {
+      int const mask = operation & 15;
+      if (mask == 0 || graph[s][operation] == not_allowed_magic)
+        continue;
+      ConditionWord::Transition transition;
+      ConditionWord::word_type expected;
+      bool expected_result;
+      if ((operation & 16))
+      {
+        transition = ConditionWord::signal_transition(to_word(s), mask, required_conditions);
+        expected = to_word(graph[s][operation]);
+        expected_result = woken[s][operation];
+      }
+      else
+      {
+        // Only a running task can call wait().
+        if (!running)
+          continue;
+        transition = ConditionWord::wait_transition(to_word(s), mask, required_conditions);
+        Task next;
+        next.set_state(graph[s][operation]);
+        expected_result = next.has_idle_counter();
+        // A task that doesn't go idle continues running with all counters reset.
+        expected = expected_result ? to_word(graph[s][operation]) : ConditionWord::running_word;
+      }
+      ++checked;
+      if (transition.m_word != expected || transition.m_result != expected_result)
+      {
+        std::ostringstream node;
+        task.print_on(node);
+        std::cout << "ConditionWord differs from the model for " << node.str() << " --" << operation_str(operation) << "->: " <<
+          std::hex << transition.m_word << " (" << transition.m_result << ") instead of " << expected << " (" << expected_result << ")" << std::dec << std::endl;
+        ++errors;
+      }
+    }
+  }
+  std::cout << "Checked " << checked << " ConditionWord transitions: " << errors << " differences." << std::endl;
+  return errors;
+}
+
+// One task thread that waits for condition 0 and two threads that signal it.
+// Every time the task goes idle exactly one signal() must wake it up.
+int check_concurrent_wake_ups()
+{
+  statefultask::ConditionWord condition_word(required_conditions);
+  std::counting_semaphore<> wake_up(0);
+  std::atomic<bool> stop = false;
+  std::atomic<int> wake_ups = 0;
+  int constexpr number_of_waits = 10000;
+  int went_idle = 0;
+
+  std::vector<std::thread> signallers;
+  for (int t = 0; t < 2; ++t)
+    signallers.emplace_back([&](){
+        while (!stop.load(std::memory_order_relaxed))
+        {
+          if (condition_word.signal(1))
+          {
+            ++wake_ups;
+            wake_up.release();
+          }
+          std::this_thread::yield();
+        }
+      });
+  for (int n = 0; n < number_of_waits; ++n)
+    if (condition_word.wait(1))
+    {
+      ++went_idle;
+      wake_up.acquire();
+    }
+  stop = true;
+  for (auto& thread : signallers)
+    thread.join();
+  bool const success = wake_ups == went_idle && !condition_word.is_idle();
+  std::cout << "Concurrent wait/signal: went idle " << went_idle << " times, woken up " << wake_ups << " times: " << (success ? "OK" : "FAILED") << std::endl;
+  return success ? 0 : 1;
+}
+
 int main()
 {
   Task counters;
 
   std::array<std::array<int, 32>, 81> graph;
+  std::array<std::array<bool, 32>, 81> woken;
   int const not_allowed_magic = 81;
   for (state_type s = 0; s < 81; ++s)
     for (int operation = 0; operation < 32; ++operation)
+    {
       graph[s][operation] = not_allowed_magic;
+      woken[s][operation] = false;
+    }
 
   for (state_type s = 0; s < 81; ++s)
   {
@@ -245,6 +360,7 @@ int main()
         else if (OR_counter_woke_up)
           counters2.reset_OR_counters();
         graph[s][operation + mask] = counters2.state();
+        woken[s][operation + mask] = woken_up;
         counters2.print_on(node2);
         std::string name2 = node2.str();
         std::cout << name2 << " --> " << std::boolalpha << woken_up << ' ';
@@ -363,4 +479,8 @@ int main()
       }
     }
   }
+
+  int errors = check_transition_table(graph, woken, not_allowed_magic);
+  errors += check_concurrent_wake_ups();
+  return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,129 @@
+#include "sys.h"
+#include "threadpool/AIThreadPool.h"
+#include "utils/threading/Gate.h"
+#include "ResultSink.h"
+#include "WorkStealingQueues.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <iostream>
+#include <thread>
+#include "debug.h"
+
+// Compare submitting tasks from inside tasks through the (locked) AIThreadPool queue
+// with submitting them through threadpool::WorkStealingQueues.
+//
+// Every task with depth > 0 submits two tasks with depth - 1; so a tree with depth d
+// runs 2^(d+1) - 1 tasks, most of which are submitted by the workers themselves.
+//
+// The wall clock time is measured with std::chrono::steady_clock: a benchmark::Stopwatch
+// would pin the main thread, and with it every thread that change_number_of_threads_to
+// adds to the pool, to a single CPU.
+
+namespace utils { using namespace threading; }
+
+int constexpr capacity = 1300;                          // The same as threadpool.cxx.
+int constexpr tree_depth = 16;
+int constexpr number_of_trees = 8;
+int constexpr spin = 200;                               // The amount of work done by every task.
+
+std::atomic_int s_remaining;
+utils::Gate* s_finished;
+
+void work()
+{
+  volatile int v __attribute__ ((unused));
+  for (int i = 0; i < spin; ++i)
+    v = i;
+}
+
+void task_done()
+{
+  if (--s_remaining == 0)
+    s_finished->open();
+}
+
+// Submit through the AIThreadPool queue directly.
+void plain_task(AIThreadPool& thread_pool, AIQueueHandle queue_handle, int depth)
+{
+  work();
+  if (depth > 0)
+  {
+    auto queues_access = thread_pool.queues_read_access();
+    auto& queue = thread_pool.get_queue(queues_access, queue_handle);
+    for (int child = 0; child < 2; ++child)
+    {
+      bool queued = false;
+      {
+        auto queue_access = queue.producer_access();
+        if (queue_access.length() < capacity)
+        {
+          queue_access.move_in([&thread_pool, queue_handle, depth](){ plain_task(thread_pool, queue_handle, depth - 1); return false; });
+          queued = true;
+        }
+      }
+      if (queued)
+        queue.notify_one();
+      else
+        plain_task(thread_pool, queue_handle, depth - 1);       // The queue is full: run it ourselves (waiting could deadlock).
+    }
+  }
+  task_done();
+}
+
+void stealing_task(threadpool::WorkStealingQueues& stealing, int priority, int depth)
+{
+  work();
+  if (depth > 0)
+    for (int child = 0; child < 2; ++child)
+      stealing.submit(priority, [&stealing, priority, depth](){ stealing_task(stealing, priority, depth - 1); return false; });
+  task_done();
+}
+
+template<typename SUBMIT>
+double measure(SUBMIT submit)
+{
+  utils::Gate finished;
+  s_finished = &finished;
+  s_remaining = number_of_trees * ((2 << tree_depth) - 1);
+  auto start = std::chrono::steady_clock::now();
+  for (int tree = 0; tree < number_of_trees; ++tree)
+    submit();
+  finished.wait();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  auto result_sink = benchmark::ResultSink::create();
+  result_sink->begin("Fan-out of " + std::to_string(number_of_trees) + " trees of depth " + std::to_string(tree_depth), "threads", "time (ms)");
+  int const max_threads = std::thread::hardware_concurrency();
+  AIThreadPool thread_pool(1);
+  AIQueueHandle queue_handle = thread_pool.new_queue(capacity);
+  // Every pool thread that runs a task of stealing gets its own deque; the number of threads only grows below.
+  auto stealing = std::make_unique<threadpool::WorkStealingQueues>(thread_pool, max_threads);
+  int const priority = stealing->add_queue(queue_handle, capacity);
+  for (int number_of_threads = 1; number_of_threads <= max_threads; number_of_threads *= 2)
+  {
+    thread_pool.change_number_of_threads_to(number_of_threads);
+
+    double plain_ms = measure([&](){
+        auto queues_access = thread_pool.queues_read_access();
+        auto& queue = thread_pool.get_queue(queues_access, queue_handle);
+        queue.producer_access().move_in([&](){ plain_task(thread_pool, queue_handle, tree_depth); return false; });
+        queue.notify_one();
+      });
+    double stealing_ms = measure([&](){
+        stealing->submit(priority, [&](){ stealing_task(*stealing, priority, tree_depth); return false; });
+      });
+
+    std::cout << number_of_threads << " threads: AIThreadPool queue: " << plain_ms << " ms; work-stealing: " << stealing_ms << " ms." << std::endl;
+    result_sink->data_point(number_of_threads, plain_ms, 0, "AIThreadPool queue");
+    result_sink->data_point(number_of_threads, stealing_ms, 0, "WorkStealingQueues");
+  }
+  result_sink->end("linespoints");
+  // Destroy stealing while the pool is still running: its destructor waits for the left over wake-up functors.
+  stealing.reset();
+}